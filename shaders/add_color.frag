@@ -0,0 +1,14 @@
+// adds the colors of the emitters.
+#include "varyings.glsl"
+#include "emitters.glsl"
+#include "dye.glsl"
+
+uniform FIELD ucTex;
+
+out vec4 FragColor;
+
+void main() {
+  C = vec3(0.0, 0.0, 0.0);
+  emitter();
+  FragColor = vec4(C.rgb, 0.0) * uStepFraction + dye(ucTex, fsUv);
+}
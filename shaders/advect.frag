@@ -0,0 +1,15 @@
+// moves the field usTex along the velocity uuTex, by tracing every cell backwards in time.
+// when the color field is split into tiles, the trace can end in another tile than the cell.
+#include "frame.glsl"
+#include "varyings.glsl"
+#include "dye.glsl"
+
+uniform FIELD uuTex;
+uniform FIELD usTex;
+
+out vec4 FragColor;
+
+void main() {
+  vec2 tc = fsUv - delta * uDt * field(uuTex, fsUv).xy;
+  FragColor = uTiledDye ? dye(usTex, tc) : field(usTex, tc);
+}
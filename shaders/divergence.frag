@@ -0,0 +1,15 @@
+#include "frame.glsl"
+#include "varyings.glsl"
+
+uniform FIELD uwTex;
+
+out vec4 FragColor;
+
+void main() {
+  vec4 wR = field(uwTex, fsUv + vec2(+1, +0) * delta);
+  vec4 wL = field(uwTex, fsUv + vec2(-1, +0) * delta);
+  vec4 wT = field(uwTex, fsUv + vec2(+0, +1) * delta);
+  vec4 wB = field(uwTex, fsUv + vec2(+0, -1) * delta);
+
+  FragColor = vec4(0.5 * (wR.x - wL.x) + 0.5 * (wT.y - wB.y));
+}
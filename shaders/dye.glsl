@@ -0,0 +1,59 @@
+// the color field can be larger than the largest texture, see initDyeTiles() in main.cpp. then it is split into tiles
+// of uDyeTileSize cells, which are the layers of its textures: the tiles of member m are the layers from m * tiles on,
+// row by row. every tile has a ring of uDyeHalo cells around it, with copies of the cells of its neighbours, so the
+// bilinear filtering of the sampler works across the edges of the tiles. see exchangeDyeHalos().
+// a color field that fits into a texture is a single tile without a halo, and these are plain field() and texelFetch().
+// the shader that includes this declares fsMember, like for fields.glsl.
+#include "frame.glsl"
+#include "fields.glsl"
+
+// the pass writes the color field, and that is split into tiles. then every instance, or every layer of a dispatch,
+// is a tile of a member. see advect() in main.cpp.
+uniform bool uTiledDye;
+
+bool dyeIsTiled() {
+  return uDyeTiles != ivec2(1);
+}
+
+int dyeLayer(ivec2 tile) {
+  return (fsMember * uDyeTiles.y + tile.y) * uDyeTiles.x + tile.x;
+}
+
+// the member and the tile of a layer of the color field.
+int dyeMemberOfLayer(int layer) {
+  return layer / (uDyeTiles.x * uDyeTiles.y);
+}
+
+ivec2 dyeTileOfLayer(int layer) {
+  int tile = layer % (uDyeTiles.x * uDyeTiles.y);
+  return ivec2(tile % uDyeTiles.x, tile / uDyeTiles.x);
+}
+
+// samples the color field at uv, in the tile that uv is in. uv is clamped to the centers of the outermost cells,
+// which is what a sampler that clamps to the edge does.
+vec4 dye(FIELD s, vec2 uv) {
+  if (!dyeIsTiled()) {
+    return field(s, uv);
+  }
+  vec2 p = clamp(uv * vec2(uDyeSize), vec2(0.5), vec2(uDyeSize) - 0.5);
+  ivec2 tile = min(ivec2(p) / uDyeTileSize, uDyeTiles - 1);
+  vec2 local = p - vec2(tile * uDyeTileSize - uDyeHalo);
+  return sampleLayer(s, local / vec2(fieldSize(s)), dyeLayer(tile));
+}
+
+// the cell p of the color field.
+vec4 dyeTexel(FIELD s, ivec2 p) {
+  if (!dyeIsTiled()) {
+    return fetchLayer(s, p, fsMember);
+  }
+  ivec2 tile = p / uDyeTileSize;
+  return fetchLayer(s, p - tile * uDyeTileSize + uDyeHalo, dyeLayer(tile));
+}
+
+// the corner pos, from 0 to 1, of the quad of the tile of a layer, which covers the cells of the tile inside its halo.
+// returns the position, and the texture coordinates of the corner in the whole color field in uv.
+vec4 dyeTileVertex(int layer, vec2 pos, out vec2 uv) {
+  vec2 cells = pos * vec2(uDyeTileSize);
+  uv = (vec2(dyeTileOfLayer(layer) * uDyeTileSize) + cells) / vec2(uDyeSize);
+  return vec4(2.0 * (cells + float(uDyeHalo)) / vec2(uDyeTileSize + 2 * uDyeHalo) - 1.0, 0.0, 1.0);
+}
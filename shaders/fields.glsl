@@ -0,0 +1,6 @@
+// in an ensemble, every field is a texture array, with a layer for every member, see --ensemble in main.cpp and
+// layers.glsl. the shader that includes this declares fsMember, the member of the cell,
+// and field() samples the field of that member.
+#include "layers.glsl"
+
+#define field(s, uv) sampleLayer(s, uv, fsMember)
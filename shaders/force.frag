@@ -0,0 +1,13 @@
+// applies the forces of the emitters.
+#include "varyings.glsl"
+#include "emitters.glsl"
+
+uniform FIELD uwTex;
+
+out vec4 FragColor;
+
+void main() {
+  F = vec2(0.0, 0.0);
+  emitter();
+  FragColor = vec4(F.xy, 0.0, 0.0) * uStepFraction + field(uwTex, fsUv);
+}
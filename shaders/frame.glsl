@@ -0,0 +1,21 @@
+// the parameters that are the same for every pass of a frame. they are written once per frame into a uniform buffer,
+// see updateFrameUniforms() in main.cpp, and this block must match FrameUniforms.
+// delta is the size of a grid cell in texture coordinates, so that the grid can be resized without recompiling anything.
+layout(std140) uniform Frame {
+  vec2 delta;
+  vec2 uAlpha;
+  vec2 uBeta;
+  float uDt;
+  float uCounter;
+  // the fraction of the frame that a substep covers. the emitters only add this much of their force and color.
+  float uStepFraction;
+  float uBlend;
+  int uSim;
+  // how much more force every member of an ensemble adds than the one before it, see emitter().
+  float uMemberForce;
+  // how the color field is split into tiles, see dye.glsl.
+  ivec2 uDyeSize;
+  ivec2 uDyeTiles;
+  ivec2 uDyeTileSize;
+  int uDyeHalo;
+};
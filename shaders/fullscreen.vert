@@ -0,0 +1,38 @@
+// all the passes are a fullscreen quad, and the actual logic is in the fragment shader.
+// the quad is split into the tiles of uTiles, one per instance, and the inactive tiles are collapsed to a point,
+// which the rasterizer drops. the passes that cover everything draw a single instance, with a single active tile.
+// in an ensemble, every member draws its own tiles, and uTiles has a layer per member. see renderFullscreen() in main.cpp.
+// the passes that write a tiled color field draw an instance per tile of it instead, see dye.glsl.
+#include "layers.glsl"
+
+layout(location = 0) in vec3 vsPos;
+
+uniform FIELD uTiles;
+
+out Varyings {
+  vec2 fsUv;
+  flat int fsMember;
+  flat int fsLayer;
+};
+
+#include "dye.glsl"
+
+void main() {
+  ivec2 tiles = fieldSize(uTiles);
+  int index = gl_InstanceID % (tiles.x * tiles.y);
+  ivec2 tile = ivec2(index % tiles.x, index / tiles.x);
+  fsLayer = gl_InstanceID / (tiles.x * tiles.y);
+  if (uTiledDye) {
+    fsMember = dyeMemberOfLayer(fsLayer);
+    gl_Position = dyeTileVertex(fsLayer, vsPos.xy, fsUv);
+    return;
+  }
+  fsMember = fsLayer;
+  fsUv = (vec2(tile) + vsPos.xy) / vec2(tiles);
+  if (fetchLayer(uTiles, tile, fsMember).x > 0.0) {
+    gl_Position = vec4(2.0 * fsUv - vec2(1.0), 0.0, 1.0);
+  }
+  else {
+    gl_Position = vec4(-2.0, -2.0, 0.0, 1.0);
+  }
+}
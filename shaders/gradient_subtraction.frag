@@ -0,0 +1,19 @@
+// subtracts the gradient of the pressure from the velocity, which makes it divergence free.
+#include "frame.glsl"
+#include "varyings.glsl"
+
+uniform FIELD upTex;
+uniform FIELD uwTex;
+
+out vec4 FragColor;
+
+void main() {
+  vec4 pR = field(upTex, fsUv + vec2(+1, +0) * delta);
+  vec4 pL = field(upTex, fsUv + vec2(-1, +0) * delta);
+  vec4 pT = field(upTex, fsUv + vec2(+0, +1) * delta);
+  vec4 pB = field(upTex, fsUv + vec2(+0, -1) * delta);
+
+  vec4 c = field(uwTex, fsUv);
+  c.xy -= vec2(0.5 * (pR.x - pL.x), 0.5 * (pT.x - pB.x));
+  FragColor = c;
+}
@@ -0,0 +1,19 @@
+// one jacobi iteration of the pressure solve.
+#include "frame.glsl"
+#include "varyings.glsl"
+
+uniform FIELD uxTex;
+uniform FIELD ubTex;
+
+out vec4 FragColor;
+
+void main() {
+  vec4 xR = field(uxTex, fsUv + vec2(+1, +0) * delta);
+  vec4 xL = field(uxTex, fsUv + vec2(-1, +0) * delta);
+  vec4 xT = field(uxTex, fsUv + vec2(+0, +1) * delta);
+  vec4 xB = field(uxTex, fsUv + vec2(+0, -1) * delta);
+
+  vec4 bC = vec4(field(ubTex, fsUv).x);
+
+  FragColor = (xR + xL + xT + xB + vec4(uAlpha.xy, 0.0, 0.0) * bC) * vec4(uBeta.xy, 0.0, 0.0);
+}
@@ -0,0 +1,53 @@
+// the common part of the compute kernels, which do the same as the fragment shaders. they fetch the neighbours
+// of a cell with texelFetch(), clamped to the edge like the samplers of the fragment shaders,
+// and write the result to uOut with store().
+//
+// every kernel declares its own group size. the advection and the emitters read at arbitrary positions,
+// or do a lot of math per cell, and run in small square groups. the stencils only read the neighbours,
+// and run in wide groups, which read whole rows of the textures at once.
+// the z of the dispatch is the layer of uOut, which is bound with all its layers. that is the member of the ensemble,
+// or a tile of a member, when the kernel writes a tiled color field. see dye.glsl.
+#include "frame.glsl"
+#include "layers.glsl"
+
+layout(binding = 0) writeonly uniform FIELD_IMAGE uOut;
+
+// the tiles to run on, like in fullscreen.vert. the cells of the inactive tiles are left alone.
+layout(binding = 3) uniform FIELD uTiles;
+
+// the cell of this invocation, its position in texture coordinates, its member, and the layer of uOut that it is in.
+ivec2 cell;
+vec2 fsUv;
+int fsMember;
+int fsLayer;
+
+#include "dye.glsl"
+
+bool startKernel() {
+  cell = ivec2(gl_GlobalInvocationID.xy);
+  fsLayer = int(gl_GlobalInvocationID.z);
+  // the cells of a tile of the color field, without its halo, which exchangeDyeHalos() fills in.
+  if (uTiledDye) {
+    fsMember = dyeMemberOfLayer(fsLayer);
+    ivec2 p = cell - uDyeHalo;
+    fsUv = (vec2(dyeTileOfLayer(fsLayer) * uDyeTileSize + p) + 0.5) / vec2(uDyeSize);
+    return all(greaterThanEqual(p, ivec2(0))) && all(lessThan(p, uDyeTileSize));
+  }
+  fsMember = fsLayer;
+  ivec2 size = imageSize(uOut).xy;
+  fsUv = (vec2(cell) + 0.5) / vec2(size);
+  ivec2 tile = ivec2(fsUv * vec2(fieldSize(uTiles)));
+  return cell.x < size.x && cell.y < size.y && fetchLayer(uTiles, tile, fsMember).x > 0.0;
+}
+
+vec4 fetch(FIELD s, ivec2 offset) {
+  return fetchLayer(s, clamp(cell + offset, ivec2(0), fieldSize(s) - 1), fsLayer);
+}
+
+void store(vec4 value) {
+#ifdef LAYERED_FIELDS
+  imageStore(uOut, ivec3(cell, fsLayer), value);
+#else
+  imageStore(uOut, cell, value);
+#endif
+}
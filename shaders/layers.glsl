@@ -0,0 +1,18 @@
+// the fields are texture arrays when main.cpp defines LAYERED_FIELDS, which it does for an ensemble, or for a tiled
+// color field, see layeredFields. otherwise they are plain 2D textures, which filter exactly like they always did.
+// FIELD and FIELD_IMAGE are the sampler and the image type of a field, and the macros take a layer,
+// which is ignored without layers. they are macros, so that without layers the shaders are the plain texture() calls
+// that they always were, down to the last bit of what the compiler makes of them.
+#ifdef LAYERED_FIELDS
+#define FIELD sampler2DArray
+#define FIELD_IMAGE image2DArray
+#define sampleLayer(s, uv, layer) texture(s, vec3(uv, float(layer)))
+#define fetchLayer(s, p, layer) texelFetch(s, ivec3(p, layer), 0)
+#else
+#define FIELD sampler2D
+#define FIELD_IMAGE image2D
+#define sampleLayer(s, uv, layer) texture(s, uv)
+#define fetchLayer(s, p, layer) texelFetch(s, p, 0)
+#endif
+
+#define fieldSize(s) textureSize(s, 0).xy
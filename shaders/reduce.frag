@@ -0,0 +1,48 @@
+// one step of the reductions of the diagnostics, see reduceField() in main.cpp. every texel sums up a block of uBlock x uBlock
+// texels of a field of size uSize, and takes the maximum of the last component. the first step computes the quantities
+// from the fields: |u|^2, the squared divergences before and after the projection, and |u|^2 again for the maximum.
+// or the red, green and blue of the color field. in an ensemble, the diagnostics are those of the first member,
+// which is the member of the single layer that this renders to.
+#include "varyings.glsl"
+#include "dye.glsl"
+
+uniform FIELD uaTex;
+uniform FIELD ubTex;
+uniform FIELD ucTex;
+uniform int uMode;
+uniform ivec2 uSize;
+uniform int uBlock;
+
+out vec4 FragColor;
+
+vec4 term(ivec2 p) {
+  if (uMode == 0) {
+    vec2 u = fetchLayer(uaTex, p, 0).xy;
+    float dBefore = fetchLayer(ubTex, p, 0).x;
+    float dAfter = fetchLayer(ucTex, p, 0).x;
+    return vec4(dot(u, u), dBefore * dBefore, dAfter * dAfter, dot(u, u));
+  }
+  else if (uMode == 1) {
+    return vec4(dyeTexel(uaTex, p).rgb, 0.0);
+  }
+  else {
+    return fetchLayer(uaTex, p, 0);
+  }
+}
+
+void main() {
+  ivec2 p = uBlock * ivec2(gl_FragCoord.xy);
+  vec3 sum = vec3(0.0);
+  float m = 0.0;
+  for (int y = 0; y < uBlock; ++y) {
+    for (int x = 0; x < uBlock; ++x) {
+      ivec2 q = p + ivec2(x, y);
+      if (q.x < uSize.x && q.y < uSize.y) {
+        vec4 t = term(q);
+        sum += t.xyz;
+        m = max(m, t.w);
+      }
+    }
+  }
+  FragColor = vec4(sum, m);
+}
@@ -0,0 +1,11 @@
+// copies a texture into one of a different size, see resizeGrid() in main.cpp.
+#include "varyings.glsl"
+
+uniform FIELD usTex;
+uniform vec4 uScale;
+
+out vec4 FragColor;
+
+void main() {
+  FragColor = field(usTex, fsUv) * uScale;
+}
@@ -0,0 +1,33 @@
+// finds the tiles where something happens, see updateActiveTiles() in main.cpp. every fragment is a tile,
+// which is active if the velocity or the color is above uThreshold in any of the cells that it covers.
+// the color field can have another size than the grid, but the tiles cover the same part of both.
+// every member of an ensemble has its own tiles.
+#include "varyings.glsl"
+
+uniform FIELD uwTex;
+uniform FIELD ucTex;
+uniform float uThreshold;
+uniform ivec2 uTileCount;
+
+out vec4 FragColor;
+
+// the largest absolute value of the channels of s in the cells of the tile.
+float tileMax(FIELD s, ivec2 tile, ivec2 tiles, vec4 channels) {
+  ivec2 size = fieldSize(s);
+  ivec2 begin = (tile * size) / tiles;
+  ivec2 end = min(((tile + 1) * size + tiles - 1) / tiles, size);
+  vec4 m = vec4(0.0);
+  for (int y = begin.y; y < end.y; ++y) {
+    for (int x = begin.x; x < end.x; ++x) {
+      m = max(m, abs(fetchLayer(s, ivec2(x, y), fsMember)));
+    }
+  }
+  m *= channels;
+  return max(max(m.x, m.y), max(m.z, m.w));
+}
+
+void main() {
+  ivec2 tile = ivec2(gl_FragCoord.xy);
+  float m = max(tileMax(uwTex, tile, uTileCount, vec4(1.0, 1.0, 0.0, 0.0)), tileMax(ucTex, tile, uTileCount, vec4(1.0, 1.0, 1.0, 0.0)));
+  FragColor = vec4(m > uThreshold ? 1.0 : 0.0);
+}
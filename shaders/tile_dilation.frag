@@ -0,0 +1,21 @@
+// grows the active tiles by uRadius tiles in every direction, see updateActiveTiles() in main.cpp.
+#include "varyings.glsl"
+
+uniform FIELD uaTex;
+uniform int uRadius;
+
+out vec4 FragColor;
+
+void main() {
+  ivec2 tile = ivec2(gl_FragCoord.xy);
+  ivec2 tiles = fieldSize(uaTex);
+  ivec2 begin = max(tile - uRadius, ivec2(0));
+  ivec2 end = min(tile + uRadius, tiles - 1);
+  float a = 0.0;
+  for (int y = begin.y; y <= end.y; ++y) {
+    for (int x = begin.x; x <= end.x; ++x) {
+      a = max(a, fetchLayer(uaTex, ivec2(x, y), fsMember).x);
+    }
+  }
+  FragColor = vec4(a);
+}
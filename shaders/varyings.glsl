@@ -0,0 +1,10 @@
+// what the fragment shaders of the passes get from fullscreen.vert, or from layered.geom in an ensemble:
+// the position of the cell in texture coordinates, the member of the ensemble that it belongs to,
+// and the layer of the render target that it is in. that is the member, or a tile of the color field, see dye.glsl.
+in Varyings {
+  vec2 fsUv;
+  flat int fsMember;
+  flat int fsLayer;
+};
+
+#include "fields.glsl"
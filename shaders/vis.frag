@@ -0,0 +1,40 @@
+// renders the color field to the window.
+// if the color field does not have the size of the window, it is filtered with a Catmull-Rom spline,
+// which is much sharper than bilinear filtering. the 16 taps of the spline are done with 9 bilinear fetches,
+// by merging the two middle taps along each axis. in an ensemble, the window shows the first member.
+// the taps of a tiled color field each come from the tile that they are in, see dye.glsl.
+#include "frame.glsl"
+#include "varyings.glsl"
+#include "dye.glsl"
+
+uniform FIELD uTex;
+uniform bool uBicubic;
+
+out vec4 FragColor;
+
+vec4 sampleCatmullRom(vec2 uv) {
+  vec2 texSize = vec2(uDyeSize);
+  vec2 samplePos = uv * texSize;
+  vec2 texPos1 = floor(samplePos - 0.5) + 0.5;
+  vec2 f = samplePos - texPos1;
+
+  vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+  vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+  vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+  vec2 w3 = f * f * (-0.5 + 0.5 * f);
+
+  vec2 w12 = w1 + w2;
+  vec2 tc0 = (texPos1 - 1.0) / texSize;
+  vec2 tc12 = (texPos1 + w2 / w12) / texSize;
+  vec2 tc3 = (texPos1 + 2.0) / texSize;
+
+  return
+    (dye(uTex, vec2(tc0.x, tc0.y)) * w0.x + dye(uTex, vec2(tc12.x, tc0.y)) * w12.x + dye(uTex, vec2(tc3.x, tc0.y)) * w3.x) * w0.y +
+    (dye(uTex, vec2(tc0.x, tc12.y)) * w0.x + dye(uTex, vec2(tc12.x, tc12.y)) * w12.x + dye(uTex, vec2(tc3.x, tc12.y)) * w3.x) * w12.y +
+    (dye(uTex, vec2(tc0.x, tc3.y)) * w0.x + dye(uTex, vec2(tc12.x, tc3.y)) * w12.x + dye(uTex, vec2(tc3.x, tc3.y)) * w3.x) * w3.y;
+}
+
+void main() {
+  vec3 c = uBicubic ? sampleCatmullRom(fsUv).rgb : dye(uTex, fsUv).rgb;
+  FragColor = vec4(pow(clamp(c, 0.0, 1.0) * uBlend, vec3(1.0 / 2.2)), 1.0);
+}
@@ -0,0 +1,11 @@
+// writes an image into the color field. the images are already flipped and in linear color, so this is a plain copy.
+// the image is the same for every member of the ensemble.
+#include "varyings.glsl"
+
+uniform FIELD ucTex;
+
+out vec4 FragColor;
+
+void main() {
+  FragColor = vec4(sampleLayer(ucTex, fsUv, 0).rgb, 1.0);
+}
@@ -0,0 +1,26 @@
+// a quad of size uSize at uOffset, in normalized device coordinates. in an ensemble, every member is an instance,
+// and in a tiled color field, every tile of every member, see dye.glsl.
+layout(location = 0) in vec3 vsPos;
+
+out Varyings {
+  vec2 fsUv;
+  flat int fsMember;
+  flat int fsLayer;
+};
+
+uniform vec2 uOffset;
+uniform vec2 uSize;
+
+#include "dye.glsl"
+
+void main() {
+  fsLayer = gl_InstanceID;
+  if (uTiledDye) {
+    fsMember = dyeMemberOfLayer(fsLayer);
+    gl_Position = dyeTileVertex(fsLayer, vsPos.xy, fsUv);
+    return;
+  }
+  fsUv = vsPos.xy;
+  fsMember = gl_InstanceID;
+  gl_Position = vec4(uSize * vsPos.xy + uOffset, 0.0, 1.0);
+}
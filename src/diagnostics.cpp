@@ -0,0 +1,72 @@
+#include "diagnostics.h"
+
+#include <cmath>
+#include <cstdio>
+
+Diagnostics computeDiagnostics(int frame, const DiagnosticSums& sums, int gridWidth, int gridHeight,
+	int dyeWidth, int dyeHeight, float dt) {
+	double gridCells = (double)gridWidth * gridHeight;
+	double dyeCells = (double)dyeWidth * dyeHeight;
+
+	Diagnostics d;
+	d.frame = frame;
+	d.kineticEnergy = 0.5 * sums.velocitySq / gridCells;
+	d.divergenceBefore = std::sqrt(sums.divergenceBeforeSq / gridCells);
+	d.divergenceAfter = std::sqrt(sums.divergenceAfterSq / gridCells);
+	d.maxSpeed = std::sqrt(sums.maxVelocitySq);
+	d.cfl = d.maxSpeed * dt;
+	for (int i = 0; i < 3; ++i) {
+		d.dyeMass[i] = sums.dye[i] / dyeCells;
+	}
+	return d;
+}
+
+bool writeMetrics(const std::string& path, const Diagnostics& d) {
+	std::string tempPath = path + ".tmp";
+	FILE* fh = fopen(tempPath.c_str(), "w");
+	if (fh == nullptr) {
+		printf("Could not open %s for writing\n", tempPath.c_str());
+		return false;
+	}
+
+	fprintf(fh, "# HELP fluid_frame The frame that the diagnostics were computed at.\n");
+	fprintf(fh, "# TYPE fluid_frame gauge\n");
+	fprintf(fh, "fluid_frame %d\n", d.frame);
+
+	fprintf(fh, "# HELP fluid_kinetic_energy Kinetic energy of the velocity field, averaged over the grid cells.\n");
+	fprintf(fh, "# TYPE fluid_kinetic_energy gauge\n");
+	fprintf(fh, "fluid_kinetic_energy %.9g\n", d.kineticEnergy);
+
+	fprintf(fh, "# HELP fluid_divergence_l2 RMS divergence of the velocity field, before and after the pressure projection.\n");
+	fprintf(fh, "# TYPE fluid_divergence_l2 gauge\n");
+	fprintf(fh, "fluid_divergence_l2{projection=\"before\"} %.9g\n", d.divergenceBefore);
+	fprintf(fh, "fluid_divergence_l2{projection=\"after\"} %.9g\n", d.divergenceAfter);
+
+	fprintf(fh, "# HELP fluid_max_speed Largest speed in the velocity field, in cells per second.\n");
+	fprintf(fh, "# TYPE fluid_max_speed gauge\n");
+	fprintf(fh, "fluid_max_speed %.9g\n", d.maxSpeed);
+
+	fprintf(fh, "# HELP fluid_cfl CFL number of a simulation step, the number of cells that the fastest cell moves.\n");
+	fprintf(fh, "# TYPE fluid_cfl gauge\n");
+	fprintf(fh, "fluid_cfl %.9g\n", d.cfl);
+
+	fprintf(fh, "# HELP fluid_dye_mass Amount of dye, averaged over the cells of the color field.\n");
+	fprintf(fh, "# TYPE fluid_dye_mass gauge\n");
+	const char* channels[] = { "r", "g", "b" };
+	for (int i = 0; i < 3; ++i) {
+		fprintf(fh, "fluid_dye_mass{channel=\"%s\"} %.9g\n", channels[i], d.dyeMass[i]);
+	}
+
+	bool ok = fclose(fh) == 0;
+	// on windows, rename() does not replace an existing file.
+	if (ok && rename(tempPath.c_str(), path.c_str()) != 0) {
+		remove(path.c_str());
+		ok = rename(tempPath.c_str(), path.c_str()) == 0;
+	}
+	if (!ok) {
+		printf("Could not write %s\n", path.c_str());
+		remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
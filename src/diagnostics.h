@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+// physical diagnostics of the simulation, for watching the health of the solver in long runs.
+//
+// the GPU reduces the fields down to a handful of sums and maxima, see issueDiagnostics() and reduceField() in main.cpp,
+// and this turns those into the actual quantities, and publishes them as a metrics file in the
+// Prometheus text format, which a scraper(for instance the textfile collector of the node exporter) can pick up.
+//
+// the velocity is in cells per second, since that is what the advection uses. energy, divergence and mass are averaged
+// over the cells, so that they do not depend on the resolution.
+
+// what the GPU reductions produce.
+struct DiagnosticSums {
+	float velocitySq;          // sum of |u|^2 over the grid cells.
+	float divergenceBeforeSq;  // sum of the squared divergence, before the pressure projection.
+	float divergenceAfterSq;   // and after it.
+	float maxVelocitySq;       // largest |u|^2.
+	float dye[3];              // sum of the red, green and blue of the color field.
+};
+
+struct Diagnostics {
+	int frame;
+	double kineticEnergy;      // 0.5 * |u|^2, averaged over the cells.
+	double divergenceBefore;   // L2 norm of the divergence, divided by the square root of the number of cells(RMS).
+	double divergenceAfter;
+	double maxSpeed;           // in cells per second.
+	double cfl;                // how many cells the fastest cell moves in one simulation step.
+	double dyeMass[3];         // average red, green and blue.
+};
+
+// dt is the time step of a single substep.
+Diagnostics computeDiagnostics(int frame, const DiagnosticSums& sums, int gridWidth, int gridHeight,
+	int dyeWidth, int dyeHeight, float dt);
+
+// writes the file through a temporary file and a rename, so that a scraper never sees half a file.
+bool writeMetrics(const std::string& path, const Diagnostics& d);
@@ -0,0 +1,85 @@
+#include "disk_cache.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+uint64_t fnv1a(const void* data, size_t n, uint64_t h) {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < n; ++i) {
+		h ^= p[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+bool readFile(const std::string& path, std::vector<uint8_t>& out) {
+	FILE* fh = fopen(path.c_str(), "rb");
+	if (fh == nullptr) {
+		return false;
+	}
+	// a stream that can not seek has no size, and is a miss like a missing file.
+	long size = fseek(fh, 0, SEEK_END) == 0 ? ftell(fh) : -1;
+	if (size < 0 || fseek(fh, 0, SEEK_SET) != 0) {
+		fclose(fh);
+		return false;
+	}
+	// the size is not trusted for the allocation, since a directory reports a bogus one. reading it fails instead.
+	out.clear();
+	uint8_t chunk[64 * 1024];
+	size_t n;
+	while ((n = fread(chunk, 1, sizeof(chunk), fh)) > 0) {
+		out.insert(out.end(), chunk, chunk + n);
+	}
+	bool ok = !ferror(fh) && out.size() == (size_t)size;
+	fclose(fh);
+	return ok;
+}
+
+std::string cacheFilePath(const std::string& dir, uint64_t hash, const char* ext) {
+	char name[64];
+	snprintf(name, sizeof(name), "%016llx.%s", (unsigned long long)hash, ext);
+	return dir + "/" + name;
+}
+
+bool readCacheFile(const std::string& path, const char magic[8], std::vector<uint8_t>& payload) {
+	std::vector<uint8_t> file;
+	if (!readFile(path, file) || file.size() < 8 || memcmp(file.data(), magic, 8) != 0) {
+		return false;
+	}
+	payload.assign(file.begin() + 8, file.end());
+	return true;
+}
+
+void writeCacheFile(const std::string& dir, const std::string& path, const char magic[8], const void* payload, size_t size) {
+#ifdef _WIN32
+	_mkdir(dir.c_str());
+#else
+	mkdir(dir.c_str(), 0755);
+#endif
+
+	std::string tmpPath = path + ".tmp";
+	FILE* fh = fopen(tmpPath.c_str(), "wb");
+	if (fh == nullptr) {
+		return;
+	}
+	bool ok = fwrite(magic, 1, 8, fh) == 8 && fwrite(payload, 1, size, fh) == size;
+	fclose(fh);
+
+	if (ok) {
+		remove(path.c_str());
+		rename(tmpPath.c_str(), path.c_str());
+	}
+	else {
+		remove(tmpPath.c_str());
+	}
+}
+
+void removeCacheFile(const std::string& path) {
+	remove(path.c_str());
+}
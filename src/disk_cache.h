@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// helpers for the on-disk caches(resampled images, program binaries).
+// every cache file is an 8 byte magic followed by a payload, and is named after a hash of
+// whatever it was computed from.
+
+uint64_t fnv1a(const void* data, size_t n, uint64_t h = 14695981039346656037ull);
+
+inline uint64_t fnv1a(const std::string& s, uint64_t h = 14695981039346656037ull) {
+	return fnv1a(s.data(), s.size(), h);
+}
+
+bool readFile(const std::string& path, std::vector<uint8_t>& out);
+
+// dir/<16 hex digits of hash>.<ext>
+std::string cacheFilePath(const std::string& dir, uint64_t hash, const char* ext);
+
+// returns false if the file does not exist, or was not written with the same magic.
+bool readCacheFile(const std::string& path, const char magic[8], std::vector<uint8_t>& payload);
+
+// creates the directory if needed. the file is written under a temporary name and then renamed,
+// so that readers never see a partially written file.
+void writeCacheFile(const std::string& dir, const std::string& path, const char magic[8], const void* payload, size_t size);
+
+// a cache file that turned out to be unusable.
+void removeCacheFile(const std::string& path);
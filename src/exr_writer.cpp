@@ -0,0 +1,335 @@
+#include "exr_writer.h"
+
+#include "trace_recorder.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+const uint32_t EXR_MAGIC = 20000630;
+const uint32_t EXR_VERSION = 2; // single part scanline file.
+
+const int EXR_PIXEL_TYPE_HALF = 1;
+const uint8_t EXR_RLE_COMPRESSION = 1;
+const uint8_t EXR_INCREASING_Y = 0;
+
+const size_t MAX_PENDING_IMAGES = 3;
+
+template <typename T>
+void put(std::vector<uint8_t>& buf, T v) {
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+	buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+void putString(std::vector<uint8_t>& buf, const std::string& s) {
+	buf.insert(buf.end(), s.begin(), s.end());
+	buf.push_back(0);
+}
+
+void putAttribute(std::vector<uint8_t>& buf, const char* name, const char* type, const std::vector<uint8_t>& value) {
+	putString(buf, name);
+	putString(buf, type);
+	put<int32_t>(buf, (int32_t)value.size());
+	buf.insert(buf.end(), value.begin(), value.end());
+}
+
+// the RLE scheme of OpenEXR: a run of n >= 3 equal bytes is stored as (n - 1, byte),
+// and n literal bytes are stored as (-n, bytes...).
+size_t rleCompress(const uint8_t* in, size_t n, uint8_t* out) {
+	const int MIN_RUN_LENGTH = 3;
+	const int MAX_RUN_LENGTH = 127;
+
+	const uint8_t* inEnd = in + n;
+	const uint8_t* runStart = in;
+	const uint8_t* runEnd = in + 1;
+	uint8_t* op = out;
+
+	while (runStart < inEnd) {
+		while (runEnd < inEnd && *runStart == *runEnd && runEnd - runStart - 1 < MAX_RUN_LENGTH) {
+			++runEnd;
+		}
+
+		if (runEnd - runStart >= MIN_RUN_LENGTH) {
+			*op++ = (uint8_t)((runEnd - runStart) - 1);
+			*op++ = *runStart;
+			runStart = runEnd;
+		}
+		else {
+			while (runEnd < inEnd &&
+				((runEnd + 1 >= inEnd || *runEnd != *(runEnd + 1)) ||
+				(runEnd + 2 >= inEnd || *(runEnd + 1) != *(runEnd + 2))) &&
+				runEnd - runStart < MAX_RUN_LENGTH) {
+				++runEnd;
+			}
+
+			*op++ = (uint8_t)(int8_t)(runStart - runEnd);
+			while (runStart < runEnd) {
+				*op++ = *runStart++;
+			}
+		}
+		++runEnd;
+	}
+	return op - out;
+}
+
+// compress one scanline block. the bytes are first split into two interleaved halves and delta encoded,
+// exactly like the reference implementation does, before the RLE pass.
+// if compression does not help, the raw data is stored, which readers detect from the size.
+void compressBlock(const std::vector<uint8_t>& raw, std::vector<uint8_t>& out) {
+	size_t n = raw.size();
+	std::vector<uint8_t> tmp(n);
+
+	{
+		uint8_t* t1 = tmp.data();
+		uint8_t* t2 = tmp.data() + (n + 1) / 2;
+		for (size_t i = 0; i < n; ++i) {
+			if (i % 2 == 0) {
+				*t1++ = raw[i];
+			}
+			else {
+				*t2++ = raw[i];
+			}
+		}
+	}
+
+	{
+		int p = tmp[0];
+		for (size_t i = 1; i < n; ++i) {
+			int d = int(tmp[i]) - p + (128 + 256);
+			p = tmp[i];
+			tmp[i] = (uint8_t)d;
+		}
+	}
+
+	out.resize(n * 3 / 2 + 2);
+	size_t size = rleCompress(tmp.data(), n, out.data());
+	if (size >= n) {
+		out = raw;
+	}
+	else {
+		out.resize(size);
+	}
+}
+
+} // namespace
+
+uint16_t floatToHalf(float f) {
+	uint32_t x;
+	memcpy(&x, &f, 4);
+
+	uint32_t sign = (x >> 16) & 0x8000;
+	int32_t fexp = (x >> 23) & 0xff;
+	uint32_t mant = x & 0x7fffff;
+
+	if (fexp == 0xff) { // inf, nan.
+		return (uint16_t)(sign | 0x7c00 | (mant ? 0x200 : 0));
+	}
+
+	int32_t exp = fexp - 127 + 15;
+	if (exp >= 31) { // too large, becomes inf.
+		return (uint16_t)(sign | 0x7c00);
+	}
+
+	if (exp <= 0) { // denormalized half.
+		if (exp < -10) {
+			return (uint16_t)sign;
+		}
+		mant |= 0x800000;
+		int shift = 14 - exp;
+		uint32_t h = mant >> shift;
+		uint32_t rem = mant & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rem > halfway || (rem == halfway && (h & 1))) {
+			++h;
+		}
+		return (uint16_t)(sign | h);
+	}
+
+	// round to nearest even. a carry out of the mantissa correctly bumps the exponent.
+	uint32_t h = sign | (exp << 10) | (mant >> 13);
+	uint32_t rem = mant & 0x1fff;
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) {
+		++h;
+	}
+	return (uint16_t)h;
+}
+
+bool writeExr(const std::string& path, int width, int height, const std::vector<ExrChannel>& unsortedChannels, int nThreads) {
+	// the channels must be stored in alphabetical order.
+	std::vector<ExrChannel> channels = unsortedChannels;
+	std::sort(channels.begin(), channels.end(), [](const ExrChannel& a, const ExrChannel& b) { return a.name < b.name; });
+
+	std::vector<uint8_t> header;
+	put<uint32_t>(header, EXR_MAGIC);
+	put<uint32_t>(header, EXR_VERSION);
+
+	{
+		std::vector<uint8_t> chlist;
+		for (const ExrChannel& c : channels) {
+			putString(chlist, c.name);
+			put<int32_t>(chlist, EXR_PIXEL_TYPE_HALF);
+			put<uint8_t>(chlist, 0); // pLinear
+			put<uint8_t>(chlist, 0);
+			put<uint8_t>(chlist, 0);
+			put<uint8_t>(chlist, 0);
+			put<int32_t>(chlist, 1); // xSampling
+			put<int32_t>(chlist, 1); // ySampling
+		}
+		chlist.push_back(0);
+		putAttribute(header, "channels", "chlist", chlist);
+	}
+	{
+		std::vector<uint8_t> v;
+		put<uint8_t>(v, EXR_RLE_COMPRESSION);
+		putAttribute(header, "compression", "compression", v);
+	}
+	{
+		std::vector<uint8_t> v;
+		put<int32_t>(v, 0);
+		put<int32_t>(v, 0);
+		put<int32_t>(v, width - 1);
+		put<int32_t>(v, height - 1);
+		putAttribute(header, "dataWindow", "box2i", v);
+		putAttribute(header, "displayWindow", "box2i", v);
+	}
+	{
+		std::vector<uint8_t> v;
+		put<uint8_t>(v, EXR_INCREASING_Y);
+		putAttribute(header, "lineOrder", "lineOrder", v);
+	}
+	{
+		std::vector<uint8_t> v;
+		put<float>(v, 1.0f);
+		putAttribute(header, "pixelAspectRatio", "float", v);
+	}
+	{
+		std::vector<uint8_t> v;
+		put<float>(v, 0.0f);
+		put<float>(v, 0.0f);
+		putAttribute(header, "screenWindowCenter", "v2f", v);
+	}
+	{
+		std::vector<uint8_t> v;
+		put<float>(v, 1.0f);
+		putAttribute(header, "screenWindowWidth", "float", v);
+	}
+	header.push_back(0);
+
+	// compress the scanlines. with RLE, every block is a single scanline.
+	std::vector<std::vector<uint8_t> > blocks(height);
+	auto compressRows = [&](int yBegin, int yEnd) {
+		traceThreadName("exr compress");
+		TraceScope trace("compress scanlines");
+		std::vector<uint8_t> raw(width * channels.size() * 2);
+		for (int y = yBegin; y < yEnd; ++y) {
+			int row = height - 1 - y;
+			uint8_t* p = raw.data();
+			for (const ExrChannel& c : channels) {
+				const float* src = c.data + (size_t)row * width * c.stride;
+				for (int x = 0; x < width; ++x) {
+					uint16_t h = floatToHalf(src[x * c.stride]);
+					*p++ = (uint8_t)(h & 0xff);
+					*p++ = (uint8_t)(h >> 8);
+				}
+			}
+			compressBlock(raw, blocks[y]);
+		}
+	};
+
+	nThreads = std::max(1, std::min(nThreads, height));
+	std::vector<std::thread> threads;
+	for (int i = 0; i < nThreads; ++i) {
+		threads.push_back(std::thread(compressRows, height * i / nThreads, height * (i + 1) / nThreads));
+	}
+	for (std::thread& t : threads) {
+		t.join();
+	}
+
+	FILE* fh = fopen(path.c_str(), "wb");
+	if (fh == nullptr) {
+		printf("Could not open %s for writing\n", path.c_str());
+		return false;
+	}
+
+	std::vector<uint8_t> offsets;
+	uint64_t offset = header.size() + (uint64_t)height * 8;
+	for (int y = 0; y < height; ++y) {
+		put<uint64_t>(offsets, offset);
+		offset += 8 + blocks[y].size();
+	}
+	fwrite(header.data(), 1, header.size(), fh);
+	fwrite(offsets.data(), 1, offsets.size(), fh);
+
+	for (int y = 0; y < height; ++y) {
+		int32_t blockHeader[2] = { y, (int32_t)blocks[y].size() };
+		fwrite(blockHeader, 1, sizeof(blockHeader), fh);
+		fwrite(blocks[y].data(), 1, blocks[y].size(), fh);
+	}
+
+	fclose(fh);
+	return true;
+}
+
+ExrExporter::ExrExporter() : nCompressThreads(1), running(false), stopping(false) {
+}
+
+ExrExporter::~ExrExporter() {
+	stop();
+}
+
+void ExrExporter::start(int nCompressThreads_) {
+	nCompressThreads = nCompressThreads_;
+	stopping = false;
+	running = true;
+	worker = std::thread(&ExrExporter::workerLoop, this);
+}
+
+void ExrExporter::push(const std::string& path, int width, int height,
+	std::vector<std::vector<float> >& buffers, const std::vector<ExrChannel>& channels) {
+	std::unique_lock<std::mutex> lock(mutex);
+	cv.wait(lock, [this] { return jobs.size() < MAX_PENDING_IMAGES; });
+
+	jobs.push_back(Job());
+	Job& job = jobs.back();
+	job.path = path;
+	job.width = width;
+	job.height = height;
+	// moving the vectors keeps their heap storage, so the channel pointers stay valid.
+	job.buffers.swap(buffers);
+	job.channels = channels;
+	cv.notify_all();
+}
+
+void ExrExporter::workerLoop() {
+	traceThreadName("exr export");
+	while (true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (jobs.empty()) {
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+			cv.notify_all();
+		}
+		TraceScope trace("write exr");
+		writeExr(job.path, job.width, job.height, job.channels, nCompressThreads);
+	}
+}
+
+void ExrExporter::stop() {
+	if (!running) {
+		return;
+	}
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+		cv.notify_all();
+	}
+	worker.join();
+	running = false;
+}
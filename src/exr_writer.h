@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// minimal OpenEXR writer: single part, scanline, HALF channels, RLE compression.
+// this is enough to get the raw simulation fields into compositing and image tools,
+// without going through the 8-bit framebuffer.
+
+struct ExrChannel {
+	std::string name;
+	const float* data; // first value of the channel.
+	int stride;        // distance between two consecutive values of the channel, in floats.
+};
+
+uint16_t floatToHalf(float f);
+
+// rows of the channel data are stored bottom to top, like OpenGL textures,
+// and are flipped when written. the scanlines are compressed on nThreads threads.
+bool writeExr(const std::string& path, int width, int height, const std::vector<ExrChannel>& channels, int nThreads);
+
+// writes EXR files on a background thread, so the render loop only pays for the readback.
+class ExrExporter {
+public:
+	ExrExporter();
+	~ExrExporter();
+
+	void start(int nCompressThreads);
+
+	// takes ownership of the buffers. the channels must point into them.
+	void push(const std::string& path, int width, int height,
+		std::vector<std::vector<float> >& buffers, const std::vector<ExrChannel>& channels);
+
+	// waits for all pending images to be written.
+	void stop();
+
+	bool isRunning() const { return running; }
+
+private:
+	struct Job {
+		std::string path;
+		int width;
+		int height;
+		std::vector<std::vector<float> > buffers;
+		std::vector<ExrChannel> channels;
+	};
+
+	void workerLoop();
+
+	int nCompressThreads;
+	bool running;
+	bool stopping;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<Job> jobs;
+};
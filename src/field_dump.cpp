@@ -0,0 +1,559 @@
+#include "field_dump.h"
+
+#include "trace_recorder.h"
+
+#include <climits>
+#include <cstring>
+#include <algorithm>
+#include <tuple>
+
+namespace {
+
+const char HEADER_MAGIC[8] = { 'F', 'L', 'D', 'D', 'U', 'M', 'P', '1' };
+const char FOOTER_MAGIC[8] = { 'F', 'L', 'D', 'I', 'N', 'D', 'E', 'X' };
+
+// frames queued for the background thread, before pushFrame() starts blocking.
+const size_t MAX_PENDING_FRAMES = 4;
+
+const int LZ4_MINMATCH = 4;
+const int LZ4_LASTLITERALS = 5;
+const int LZ4_MFLIMIT = 12;
+const int LZ4_HASH_LOG = 14;
+
+inline uint32_t read32(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+inline uint32_t lz4Hash(uint32_t seq) {
+	return (seq * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+// lengths of 15 or more continue in extra bytes.
+inline uint8_t* writeLength(uint8_t* op, size_t len) {
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+inline uint8_t* writeSequence(uint8_t* op, const uint8_t* literals, size_t literalLen, size_t offset, size_t matchLen) {
+	uint8_t* token = op++;
+	*token = (uint8_t)((literalLen >= 15 ? 15 : literalLen) << 4);
+	if (literalLen >= 15) {
+		op = writeLength(op, literalLen - 15);
+	}
+	memcpy(op, literals, literalLen);
+	op += literalLen;
+
+	if (matchLen == 0) { // last sequence, literals only.
+		return op;
+	}
+
+	*op++ = (uint8_t)(offset & 0xff);
+	*op++ = (uint8_t)(offset >> 8);
+
+	size_t ml = matchLen - LZ4_MINMATCH;
+	*token |= (uint8_t)(ml >= 15 ? 15 : ml);
+	if (ml >= 15) {
+		op = writeLength(op, ml - 15);
+	}
+	return op;
+}
+
+template <typename T>
+void put(std::vector<uint8_t>& buf, T v) {
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+	buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+T get(const uint8_t*& p) {
+	T v;
+	memcpy(&v, p, sizeof(T));
+	p += sizeof(T);
+	return v;
+}
+
+const size_t INDEX_ENTRY_SIZE = 4 + 2 + 2 + 2 + 1 + 1 + 8 + 4 + 4;
+const size_t FOOTER_SIZE = 8 + 8 + 8;
+
+typedef std::tuple<uint32_t, uint16_t, uint16_t, uint16_t> EntryKey;
+
+// the order of the chunks in FieldDumpReader::sortedEntries.
+inline EntryKey entryKey(const DumpIndexEntry& e) {
+	return EntryKey(e.frame, e.field, e.tileY, e.tileX);
+}
+
+} // namespace
+
+size_t lz4CompressBound(size_t n) {
+	return n + n / 255 + 16;
+}
+
+size_t lz4Compress(const uint8_t* src, size_t n, uint8_t* dst) {
+	std::vector<int64_t> table(1 << LZ4_HASH_LOG, -1);
+
+	uint8_t* op = dst;
+	size_t anchor = 0;
+
+	if (n >= (size_t)LZ4_MFLIMIT + 1) {
+		const size_t matchStartLimit = n - LZ4_MFLIMIT;
+		const size_t matchEndLimit = n - LZ4_LASTLITERALS;
+
+		size_t ip = 0;
+		while (ip < matchStartLimit) {
+			uint32_t seq = read32(src + ip);
+			uint32_t h = lz4Hash(seq);
+			int64_t ref = table[h];
+			table[h] = (int64_t)ip;
+
+			if (ref < 0 || ip - (size_t)ref > 65535 || read32(src + ref) != seq) {
+				++ip;
+				continue;
+			}
+
+			size_t matchLen = LZ4_MINMATCH;
+			while (ip + matchLen < matchEndLimit && src[ref + matchLen] == src[ip + matchLen]) {
+				++matchLen;
+			}
+
+			op = writeSequence(op, src + anchor, ip - anchor, ip - (size_t)ref, matchLen);
+			ip += matchLen;
+			anchor = ip;
+		}
+	}
+
+	op = writeSequence(op, src + anchor, n - anchor, 0, 0);
+	return op - dst;
+}
+
+bool lz4Decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t dstSize) {
+	const uint8_t* ip = src;
+	const uint8_t* ipEnd = src + n;
+	uint8_t* op = dst;
+	uint8_t* opEnd = dst + dstSize;
+
+	while (ip < ipEnd) {
+		uint8_t token = *ip++;
+
+		size_t literalLen = token >> 4;
+		if (literalLen == 15) {
+			uint8_t b;
+			do {
+				if (ip >= ipEnd) return false;
+				b = *ip++;
+				literalLen += b;
+			} while (b == 255);
+		}
+		if ((size_t)(ipEnd - ip) < literalLen || (size_t)(opEnd - op) < literalLen) return false;
+		memcpy(op, ip, literalLen);
+		ip += literalLen;
+		op += literalLen;
+
+		if (ip == ipEnd) { // the last sequence has no match.
+			break;
+		}
+
+		if (ipEnd - ip < 2) return false;
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst)) return false;
+
+		size_t matchLen = token & 15;
+		if (matchLen == 15) {
+			uint8_t b;
+			do {
+				if (ip >= ipEnd) return false;
+				b = *ip++;
+				matchLen += b;
+			} while (b == 255);
+		}
+		matchLen += LZ4_MINMATCH;
+		if ((size_t)(opEnd - op) < matchLen) return false;
+
+		// matches may overlap the output they are copying, so copy bytewise.
+		const uint8_t* match = op - offset;
+		for (size_t i = 0; i < matchLen; ++i) {
+			op[i] = match[i];
+		}
+		op += matchLen;
+	}
+
+	return op == opEnd;
+}
+
+void byteShuffle(const uint8_t* src, size_t n, size_t elemSize, uint8_t* dst) {
+	for (size_t b = 0; b < elemSize; ++b) {
+		uint8_t* plane = dst + b * n;
+		for (size_t i = 0; i < n; ++i) {
+			plane[i] = src[i * elemSize + b];
+		}
+	}
+}
+
+void byteUnshuffle(const uint8_t* src, size_t n, size_t elemSize, uint8_t* dst) {
+	for (size_t b = 0; b < elemSize; ++b) {
+		const uint8_t* plane = src + b * n;
+		for (size_t i = 0; i < n; ++i) {
+			dst[i * elemSize + b] = plane[i];
+		}
+	}
+}
+
+FieldDumpWriter::FieldDumpWriter() : fh(nullptr), tileSize(0), writeOffset(0), stopping(false) {
+}
+
+FieldDumpWriter::~FieldDumpWriter() {
+	close();
+}
+
+int FieldDumpWriter::addField(const std::string& name, int width, int height, int channels) {
+	fields.push_back(DumpField{ name, width, height, channels });
+	return (int)fields.size() - 1;
+}
+
+bool FieldDumpWriter::open(const std::string& path, int tileSize_) {
+	fh = fopen(path.c_str(), "wb");
+	if (fh == nullptr) {
+		printf("Could not open %s for writing the field dump\n", path.c_str());
+		return false;
+	}
+	tileSize = tileSize_;
+
+	std::vector<uint8_t> header;
+	header.insert(header.end(), HEADER_MAGIC, HEADER_MAGIC + 8);
+	put<uint32_t>(header, (uint32_t)tileSize);
+	put<uint32_t>(header, (uint32_t)fields.size());
+	for (const DumpField& f : fields) {
+		char name[16] = { 0 };
+		strncpy(name, f.name.c_str(), sizeof(name) - 1);
+		header.insert(header.end(), name, name + sizeof(name));
+		put<uint32_t>(header, (uint32_t)f.width);
+		put<uint32_t>(header, (uint32_t)f.height);
+		put<uint32_t>(header, (uint32_t)f.channels);
+	}
+	fwrite(header.data(), 1, header.size(), fh);
+	writeOffset = header.size();
+
+	stopping = false;
+	worker = std::thread(&FieldDumpWriter::workerLoop, this);
+	return true;
+}
+
+void FieldDumpWriter::pushFrame(int frame, std::vector<std::vector<float> >& data) {
+	std::unique_lock<std::mutex> lock(mutex);
+	cv.wait(lock, [this] { return jobs.size() < MAX_PENDING_FRAMES; });
+
+	jobs.push_back(Job());
+	jobs.back().frame = frame;
+	jobs.back().data.swap(data);
+	cv.notify_all();
+}
+
+void FieldDumpWriter::workerLoop() {
+	traceThreadName("field dump");
+	while (true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (jobs.empty()) {
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+			cv.notify_all();
+		}
+		TraceScope trace("write frame");
+		writeFrame(job);
+	}
+}
+
+void FieldDumpWriter::writeFrame(const Job& job) {
+	std::vector<float> tile;
+	std::vector<uint8_t> shuffled;
+	std::vector<uint8_t> compressed;
+
+	for (size_t iField = 0; iField < fields.size(); ++iField) {
+		const DumpField& f = fields[iField];
+		const float* src = job.data[iField].data();
+
+		for (int ty = 0; ty * tileSize < f.height; ++ty) {
+			for (int tx = 0; tx * tileSize < f.width; ++tx) {
+				int x0 = tx * tileSize;
+				int y0 = ty * tileSize;
+				int w = std::min(tileSize, f.width - x0);
+				int h = std::min(tileSize, f.height - y0);
+
+				tile.resize(w * h * f.channels);
+				for (int y = 0; y < h; ++y) {
+					memcpy(&tile[y * w * f.channels], src + ((y0 + y) * f.width + x0) * f.channels, w * f.channels * sizeof(float));
+				}
+
+				size_t rawSize = tile.size() * sizeof(float);
+				shuffled.resize(rawSize);
+				byteShuffle(reinterpret_cast<const uint8_t*>(tile.data()), tile.size(), sizeof(float), shuffled.data());
+
+				compressed.resize(lz4CompressBound(rawSize));
+				size_t compressedSize = lz4Compress(shuffled.data(), rawSize, compressed.data());
+
+				DumpIndexEntry e;
+				e.frame = (uint32_t)job.frame;
+				e.field = (uint16_t)iField;
+				e.tileX = (uint16_t)tx;
+				e.tileY = (uint16_t)ty;
+				e.offset = writeOffset;
+				e.rawSize = (uint32_t)rawSize;
+
+				if (compressedSize < rawSize) {
+					e.codec = DUMP_CODEC_SHUFFLE_LZ4;
+					e.compressedSize = (uint32_t)compressedSize;
+					fwrite(compressed.data(), 1, compressedSize, fh);
+				} else {
+					e.codec = DUMP_CODEC_RAW;
+					e.compressedSize = (uint32_t)rawSize;
+					fwrite(shuffled.data(), 1, rawSize, fh);
+				}
+				writeOffset += e.compressedSize;
+				index.push_back(e);
+			}
+		}
+	}
+}
+
+void FieldDumpWriter::close() {
+	if (fh == nullptr) {
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+		cv.notify_all();
+	}
+	worker.join();
+
+	std::vector<uint8_t> buf;
+	for (const DumpIndexEntry& e : index) {
+		put<uint32_t>(buf, e.frame);
+		put<uint16_t>(buf, e.field);
+		put<uint16_t>(buf, e.tileX);
+		put<uint16_t>(buf, e.tileY);
+		put<uint8_t>(buf, e.codec);
+		put<uint8_t>(buf, 0);
+		put<uint64_t>(buf, e.offset);
+		put<uint32_t>(buf, e.compressedSize);
+		put<uint32_t>(buf, e.rawSize);
+	}
+	put<uint64_t>(buf, writeOffset);
+	put<uint64_t>(buf, (uint64_t)index.size());
+	buf.insert(buf.end(), FOOTER_MAGIC, FOOTER_MAGIC + 8);
+	fwrite(buf.data(), 1, buf.size(), fh);
+
+	fclose(fh);
+	fh = nullptr;
+	index.clear();
+}
+
+FieldDumpReader::FieldDumpReader() : fh(nullptr), tileSize(0), indexOffset(0) {
+}
+
+FieldDumpReader::~FieldDumpReader() {
+	close();
+}
+
+bool FieldDumpReader::open(const std::string& path) {
+	fh = fopen(path.c_str(), "rb");
+	if (fh == nullptr) {
+		return false;
+	}
+
+	uint8_t header[16];
+	if (fread(header, 1, 16, fh) != 16 || memcmp(header, HEADER_MAGIC, 8) != 0) {
+		close();
+		return false;
+	}
+	const uint8_t* p = header + 8;
+	uint32_t headerTileSize = get<uint32_t>(p);
+	uint32_t fieldCount = get<uint32_t>(p);
+	if (headerTileSize == 0 || headerTileSize > INT_MAX) {
+		close();
+		return false;
+	}
+	tileSize = (int)headerTileSize;
+
+	fields.clear();
+	for (uint32_t i = 0; i < fieldCount; ++i) {
+		uint8_t rec[16 + 12];
+		if (fread(rec, 1, sizeof(rec), fh) != sizeof(rec)) {
+			close();
+			return false;
+		}
+		DumpField f;
+		f.name = std::string(reinterpret_cast<const char*>(rec), strnlen(reinterpret_cast<const char*>(rec), 16));
+		p = rec + 16;
+		uint32_t width = get<uint32_t>(p);
+		uint32_t height = get<uint32_t>(p);
+		uint32_t channels = get<uint32_t>(p);
+		// a whole field must be addressable with an int, see readRegion().
+		if (width == 0 || height == 0 || channels == 0 || (uint64_t)width * height * channels > INT_MAX) {
+			close();
+			return false;
+		}
+		f.width = (int)width;
+		f.height = (int)height;
+		f.channels = (int)channels;
+		fields.push_back(f);
+	}
+
+	uint8_t footer[FOOTER_SIZE];
+	if (fseek(fh, -(long)FOOTER_SIZE, SEEK_END) != 0 || fread(footer, 1, FOOTER_SIZE, fh) != FOOTER_SIZE ||
+		memcmp(footer + 16, FOOTER_MAGIC, 8) != 0) {
+		// the writer never got to close the file.
+		close();
+		return false;
+	}
+	p = footer;
+	indexOffset = get<uint64_t>(p);
+	uint64_t entryCount = get<uint64_t>(p);
+	// the index must fit between the chunks and the footer, so that a damaged footer can not make us allocate
+	// more than the file has.
+	uint64_t indexEnd = (uint64_t)ftell(fh) - FOOTER_SIZE;
+	if (indexOffset > indexEnd || entryCount > (indexEnd - indexOffset) / INDEX_ENTRY_SIZE) {
+		close();
+		return false;
+	}
+
+	std::vector<uint8_t> buf(entryCount * INDEX_ENTRY_SIZE);
+	if (fseek(fh, (long)indexOffset, SEEK_SET) != 0 || fread(buf.data(), 1, buf.size(), fh) != buf.size()) {
+		close();
+		return false;
+	}
+	index.resize(entryCount);
+	p = buf.data();
+	for (DumpIndexEntry& e : index) {
+		e.frame = get<uint32_t>(p);
+		e.field = get<uint16_t>(p);
+		e.tileX = get<uint16_t>(p);
+		e.tileY = get<uint16_t>(p);
+		e.codec = get<uint8_t>(p);
+		get<uint8_t>(p);
+		e.offset = get<uint64_t>(p);
+		e.compressedSize = get<uint32_t>(p);
+		e.rawSize = get<uint32_t>(p);
+	}
+
+	sortedEntries.resize(index.size());
+	for (size_t i = 0; i < index.size(); ++i) {
+		sortedEntries[i] = i;
+	}
+	std::sort(sortedEntries.begin(), sortedEntries.end(), [this](size_t a, size_t b) {
+		return std::make_pair(entryKey(index[a]), a) < std::make_pair(entryKey(index[b]), b);
+	});
+	return true;
+}
+
+void FieldDumpReader::close() {
+	if (fh != nullptr) {
+		fclose(fh);
+		fh = nullptr;
+	}
+	tileSize = 0;
+	indexOffset = 0;
+	fields.clear();
+	index.clear();
+	sortedEntries.clear();
+}
+
+// a binary search of sortedEntries. a chunk that is in the index twice is found where it was written first.
+const DumpIndexEntry* FieldDumpReader::findEntry(int frame, int field, int tileX, int tileY) const {
+	if (frame < 0 || field < 0 || field > 0xFFFF || tileX < 0 || tileX > 0xFFFF || tileY < 0 || tileY > 0xFFFF) {
+		return nullptr;
+	}
+	EntryKey key((uint32_t)frame, (uint16_t)field, (uint16_t)tileY, (uint16_t)tileX);
+	auto it = std::lower_bound(sortedEntries.begin(), sortedEntries.end(), key, [this](size_t i, const EntryKey& k) {
+		return entryKey(index[i]) < k;
+	});
+	if (it == sortedEntries.end() || entryKey(index[*it]) != key) {
+		return nullptr;
+	}
+	return &index[*it];
+}
+
+bool FieldDumpReader::readTile(int frame, int field, int tileX, int tileY, std::vector<float>& out, int* w, int* h) {
+	if (field < 0 || field >= (int)fields.size()) {
+		return false;
+	}
+	const DumpIndexEntry* e = findEntry(frame, field, tileX, tileY);
+	if (e == nullptr) {
+		return false;
+	}
+	const DumpField& f = fields[field];
+	long long x0 = (long long)tileX * tileSize;
+	long long y0 = (long long)tileY * tileSize;
+	if (x0 >= f.width || y0 >= f.height) {
+		return false;
+	}
+	*w = (int)std::min<long long>(tileSize, f.width - x0);
+	*h = (int)std::min<long long>(tileSize, f.height - y0);
+
+	// the sizes in the entry must match the tile, and the chunk must lie before the index, so that a damaged entry
+	// can not make us read past the buffers, or allocate more than the file has.
+	if (e->rawSize != (uint64_t)*w * *h * f.channels * sizeof(float) ||
+		(e->codec != DUMP_CODEC_SHUFFLE_LZ4 && (e->codec != DUMP_CODEC_RAW || e->compressedSize != e->rawSize)) ||
+		e->offset > indexOffset || e->compressedSize > indexOffset - e->offset) {
+		return false;
+	}
+
+	std::vector<uint8_t> chunk(e->compressedSize);
+	if (fseek(fh, (long)e->offset, SEEK_SET) != 0 || fread(chunk.data(), 1, chunk.size(), fh) != chunk.size()) {
+		return false;
+	}
+
+	std::vector<uint8_t> shuffled;
+	if (e->codec == DUMP_CODEC_SHUFFLE_LZ4) {
+		shuffled.resize(e->rawSize);
+		if (!lz4Decompress(chunk.data(), chunk.size(), shuffled.data(), shuffled.size())) {
+			return false;
+		}
+	} else {
+		shuffled.swap(chunk);
+	}
+
+	out.resize(e->rawSize / sizeof(float));
+	byteUnshuffle(shuffled.data(), out.size(), sizeof(float), reinterpret_cast<uint8_t*>(out.data()));
+	return true;
+}
+
+bool FieldDumpReader::readRegion(int frame, int field, int x, int y, int w, int h, std::vector<float>& out) {
+	if (field < 0 || field >= (int)fields.size()) {
+		return false;
+	}
+	const DumpField& f = fields[field];
+	out.assign(w * h * f.channels, 0.0f);
+
+	std::vector<float> tile;
+	for (int ty = y / tileSize; ty * tileSize < y + h; ++ty) {
+		for (int tx = x / tileSize; tx * tileSize < x + w; ++tx) {
+			int tw, th;
+			if (!readTile(frame, field, tx, ty, tile, &tw, &th)) {
+				return false;
+			}
+
+			int x0 = std::max(x, tx * tileSize);
+			int x1 = std::min(x + w, tx * tileSize + tw);
+			int y0 = std::max(y, ty * tileSize);
+			int y1 = std::min(y + h, ty * tileSize + th);
+			for (int yy = y0; yy < y1; ++yy) {
+				memcpy(&out[((yy - y) * w + (x0 - x)) * f.channels],
+					&tile[((yy - ty * tileSize) * tw + (x0 - tx * tileSize)) * f.channels],
+					(x1 - x0) * f.channels * sizeof(float));
+			}
+		}
+	}
+	return true;
+}
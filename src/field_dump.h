@@ -0,0 +1,149 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// chunked, compressed time-series dump of simulation fields, meant for offline analysis.
+//
+// every field is split into square tiles, and every tile of every recorded frame is
+// stored as an independent chunk. a chunk is the tile's float32 data (rows bottom to top,
+// channels interleaved), byte-shuffled (all first bytes of the floats, then all second bytes, ...)
+// and then compressed with the LZ4 block format. so analysis tools can use any LZ4
+// implementation(for instance lz4.block.decompress in python) to decode chunks,
+// and they only have to read the tiles they actually need.
+//
+// file layout(everything is little endian):
+//
+//   header:
+//     char magic[8]          "FLDDUMP1"
+//     u32  tileSize
+//     u32  fieldCount
+//     fieldCount times:
+//       char name[16]        zero padded
+//       u32  width, height, channels
+//   chunks, back to back.
+//   index, entryCount times:
+//     u32 frame, u16 field, u16 tileX, u16 tileY, u8 codec, u8 pad,
+//     u64 offset, u32 compressedSize, u32 rawSize
+//   footer:
+//     u64  indexOffset
+//     u64  entryCount
+//     char magic[8]          "FLDINDEX"
+//
+// codec is 0 for a chunk that is stored shuffled but uncompressed(done when LZ4 did not help),
+// and 1 for a chunk that is shuffled and LZ4 compressed.
+
+enum DumpCodec {
+	DUMP_CODEC_RAW = 0,
+	DUMP_CODEC_SHUFFLE_LZ4 = 1,
+};
+
+struct DumpField {
+	std::string name;
+	int width;
+	int height;
+	int channels;
+};
+
+struct DumpIndexEntry {
+	uint32_t frame;
+	uint16_t field;
+	uint16_t tileX;
+	uint16_t tileY;
+	uint8_t codec;
+	uint64_t offset;
+	uint32_t compressedSize;
+	uint32_t rawSize;
+};
+
+// LZ4 block format. dst must be able to hold lz4CompressBound(n) bytes.
+size_t lz4CompressBound(size_t n);
+size_t lz4Compress(const uint8_t* src, size_t n, uint8_t* dst);
+// returns false if the compressed data is malformed, or does not decode to exactly dstSize bytes.
+bool lz4Decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t dstSize);
+
+// split the n elements of elemSize bytes into elemSize byte planes, and back.
+void byteShuffle(const uint8_t* src, size_t n, size_t elemSize, uint8_t* dst);
+void byteUnshuffle(const uint8_t* src, size_t n, size_t elemSize, uint8_t* dst);
+
+// writes a dump file. the tiling, compression and the file writes happen on a background thread,
+// so the render loop only pays for the readback.
+class FieldDumpWriter {
+public:
+	FieldDumpWriter();
+	~FieldDumpWriter();
+
+	// all fields must be added before the first frame is pushed.
+	int addField(const std::string& name, int width, int height, int channels);
+
+	bool open(const std::string& path, int tileSize);
+
+	// data holds one float buffer per field, in the order they were added.
+	// takes ownership of the buffers.
+	void pushFrame(int frame, std::vector<std::vector<float> >& data);
+
+	// waits for all pending frames, then writes the index and closes the file.
+	void close();
+
+	bool isOpen() const { return fh != nullptr; }
+
+private:
+	struct Job {
+		int frame;
+		std::vector<std::vector<float> > data;
+	};
+
+	void workerLoop();
+	void writeFrame(const Job& job);
+
+	FILE* fh;
+	int tileSize;
+	uint64_t writeOffset;
+	std::vector<DumpField> fields;
+	std::vector<DumpIndexEntry> index;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<Job> jobs;
+	bool stopping;
+};
+
+// random access reader for dump files.
+class FieldDumpReader {
+public:
+	FieldDumpReader();
+	~FieldDumpReader();
+
+	bool open(const std::string& path);
+	void close();
+
+	int getTileSize() const { return tileSize; }
+	const std::vector<DumpField>& getFields() const { return fields; }
+	const std::vector<DumpIndexEntry>& getIndex() const { return index; }
+
+	// decode a single tile. out receives the tile's floats, and the tile's actual size
+	// (border tiles may be smaller than tileSize).
+	bool readTile(int frame, int field, int tileX, int tileY, std::vector<float>& out, int* w, int* h);
+
+	// decode the region [x, x + w) x [y, y + h) of a field, touching only the overlapping tiles.
+	bool readRegion(int frame, int field, int x, int y, int w, int h, std::vector<float>& out);
+
+private:
+	const DumpIndexEntry* findEntry(int frame, int field, int tileX, int tileY) const;
+
+	FILE* fh;
+	int tileSize;
+	// where the index starts, which is where the chunks end.
+	uint64_t indexOffset;
+	std::vector<DumpField> fields;
+	std::vector<DumpIndexEntry> index;
+	// the positions of the entries of index, sorted by frame, field and tile, so findEntry() does not scan the index.
+	std::vector<size_t> sortedEntries;
+};
@@ -0,0 +1,77 @@
+#include "gl_debug_log.h"
+
+#include <cstdio>
+
+#include "trace_recorder.h"
+
+GlDebugLog::GlDebugLog() : stopping(false) {
+}
+
+GlDebugLog::~GlDebugLog() {
+	stop();
+}
+
+void GlDebugLog::start() {
+	stopping = false;
+	worker = std::thread(&GlDebugLog::workerLoop, this);
+}
+
+void GlDebugLog::stop() {
+	if (!worker.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		cv.notify_all();
+	}
+	worker.join();
+}
+
+void GlDebugLog::push(const char* severity, const char* source, const char* type, unsigned id, const char* scope,
+	const char* message, int length) {
+	Message m;
+	m.severity = severity;
+	m.source = source;
+	m.type = type;
+	m.id = id;
+	m.scope = scope;
+	m.text = length < 0 ? std::string(message) : std::string(message, length);
+	while (!m.text.empty() && (m.text.back() == '\n' || m.text.back() == '\0')) {
+		m.text.pop_back();
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	messages.push_back(std::move(m));
+	cv.notify_all();
+}
+
+void GlDebugLog::workerLoop() {
+	traceThreadName("gl debug log");
+	for (;;) {
+		std::deque<Message> batch;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this] { return stopping || !messages.empty(); });
+			if (messages.empty()) {
+				return;
+			}
+			batch.swap(messages);
+		}
+		for (const Message& m : batch) {
+			print(m);
+		}
+		fflush(stdout);
+	}
+}
+
+void GlDebugLog::print(const Message& m) {
+	int n = ++repeats[std::make_pair(std::string(m.source), m.id)];
+	if (n > MAX_REPEATS) {
+		return;
+	}
+	printf("GL %s %s %s %u in \"%s\": %s\n", m.severity, m.source, m.type, m.id, m.scope, m.text.c_str());
+	if (n == MAX_REPEATS) {
+		printf("GL message %u was repeated %d times, and will not be printed again\n", m.id, MAX_REPEATS);
+	}
+}
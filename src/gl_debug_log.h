@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+// prints the messages of the KHR_debug callback, and the GL errors found at the dpush()/dpop() scopes, see main.cpp.
+//
+// the callback can be called in the middle of any GL call, and with asynchronous debug output even from a thread
+// of the driver. so it only copies the message into a queue, and a background thread does the printing.
+// every message is tagged with the innermost scope that was open when it arrived. with asynchronous output
+// that scope can be a little off, since the driver may report a message some time after the call that caused it.
+//
+// drivers like to repeat the same message every frame, so a message is only printed MAX_REPEATS times.
+// messages are told apart by their source and id.
+
+class GlDebugLog {
+public:
+	GlDebugLog();
+	~GlDebugLog();
+
+	void start();
+	// prints everything that is still queued.
+	void stop();
+	bool isRunning() const { return worker.joinable(); }
+
+	// the strings must be string literals, except for message, which is copied.
+	void push(const char* severity, const char* source, const char* type, unsigned id, const char* scope,
+		const char* message, int length);
+
+private:
+	struct Message {
+		const char* severity;
+		const char* source;
+		const char* type;
+		unsigned id;
+		const char* scope;
+		std::string text;
+	};
+
+	void workerLoop();
+	void print(const Message& m);
+
+	static const int MAX_REPEATS = 10;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<Message> messages;
+	bool stopping;
+
+	// only touched by the worker.
+	std::map<std::pair<std::string, unsigned>, int> repeats;
+};
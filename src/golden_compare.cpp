@@ -0,0 +1,157 @@
+#include "golden_compare.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#include "disk_cache.h"
+
+FieldError fieldError(const std::vector<float>& reference, const std::vector<float>& data) {
+	double maxAbs = 0.0;
+	double sumSq = 0.0;
+	double peak = 0.0;
+	size_t n = std::min(reference.size(), data.size());
+	for (size_t i = 0; i < n; ++i) {
+		double d = std::fabs((double)data[i] - (double)reference[i]);
+		// a NaN on either side counts as an infinite error, so that it can never pass.
+		if (d != d) {
+			d = std::numeric_limits<double>::infinity();
+		}
+		maxAbs = std::max(maxAbs, d);
+		sumSq += d * d;
+		peak = std::max(peak, (double)std::fabs(reference[i]));
+	}
+
+	FieldError e;
+	e.maxAbs = maxAbs;
+	e.rms = n == 0 ? 0.0 : std::sqrt(sumSq / n);
+	if (e.rms == 0.0) {
+		e.psnr = std::numeric_limits<double>::infinity();
+	}
+	else {
+		// a reference that is zero everywhere has no peak, so use 1 instead.
+		e.psnr = 20.0 * std::log10((peak > 0.0 ? peak : 1.0) / e.rms);
+	}
+	return e;
+}
+
+bool GoldenComparer::open(const std::string& path) {
+	if (!reader.open(path)) {
+		printf("Could not open reference dump %s\n", path.c_str());
+		return false;
+	}
+
+	frames.clear();
+	for (const DumpIndexEntry& e : reader.getIndex()) {
+		frames.push_back((int)e.frame);
+	}
+	std::sort(frames.begin(), frames.end());
+	frames.erase(std::unique(frames.begin(), frames.end()), frames.end());
+	if (frames.empty()) {
+		printf("Reference dump %s has no frames\n", path.c_str());
+		return false;
+	}
+
+	printf("Comparing against %s: %d frames, from frame %d to %d\n", path.c_str(), (int)frames.size(), frames.front(), frames.back());
+	opened = true;
+	return true;
+}
+
+void GoldenComparer::setTolerance(const std::string& field, double maxAbs) {
+	tolerances[field] = maxAbs;
+}
+
+bool GoldenComparer::hasFrame(int frame) const {
+	return std::binary_search(frames.begin(), frames.end(), frame);
+}
+
+bool GoldenComparer::hasField(const std::string& name) const {
+	for (const DumpField& f : reader.getFields()) {
+		if (f.name == name) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool GoldenComparer::compareFrame(int frame, const std::vector<std::string>& names, const std::vector<std::vector<float> >& data) {
+	bool ok = true;
+	const std::vector<DumpField>& fields = reader.getFields();
+	for (size_t i = 0; i < names.size(); ++i) {
+		int field = -1;
+		for (size_t j = 0; j < fields.size(); ++j) {
+			if (fields[j].name == names[i]) {
+				field = (int)j;
+			}
+		}
+		if (field == -1) {
+			printf("frame %5d %-10s is not in the reference\n", frame, names[i].c_str());
+			missingFields++;
+			ok = false;
+			continue;
+		}
+
+		const DumpField& f = fields[field];
+		if ((size_t)f.width * f.height * f.channels != data[i].size()) {
+			printf("frame %5d %-10s size differs from the reference(%dx%d), can not compare\n", frame, names[i].c_str(), f.width, f.height);
+			ok = false;
+			continue;
+		}
+
+		std::vector<float> reference;
+		if (!reader.readRegion(frame, field, 0, 0, f.width, f.height, reference)) {
+			printf("frame %5d %-10s could not be read from the reference\n", frame, names[i].c_str());
+			missingFrames++;
+			ok = false;
+			continue;
+		}
+
+		FieldError e = fieldError(reference, data[i]);
+		double tolerance = tolerances.count(names[i]) ? tolerances[names[i]] : 0.0;
+		bool pass = e.maxAbs <= tolerance;
+		printf("frame %5d %-10s max abs %10.3e  rms %10.3e  psnr %7.2f dB  hash %016llx  %s\n",
+			frame, names[i].c_str(), e.maxAbs, e.rms, e.psnr, (unsigned long long)fnv1a(data[i].data(), data[i].size() * sizeof(float)), pass ? "ok" : "FAIL");
+		ok = ok && pass;
+
+		auto it = worst.find(names[i]);
+		if (it == worst.end()) {
+			worst[names[i]] = Worst{ e, frame, 1 };
+		}
+		else {
+			Worst& w = it->second;
+			if (e.maxAbs > w.error.maxAbs) {
+				w.error.maxAbs = e.maxAbs;
+				w.frame = frame;
+			}
+			w.error.rms = std::max(w.error.rms, e.rms);
+			w.error.psnr = std::min(w.error.psnr, e.psnr);
+			w.comparedFrames++;
+		}
+	}
+
+	failed = failed || !ok;
+	return ok;
+}
+
+bool GoldenComparer::printSummary() const {
+	printf("Worst errors against the reference:\n");
+	printf("  %-10s %10s %10s %10s %10s %10s %8s\n", "field", "max abs", "at frame", "rms", "psnr(dB)", "tolerance", "frames");
+	for (const auto& kv : worst) {
+		const Worst& w = kv.second;
+		double tolerance = tolerances.count(kv.first) ? tolerances.at(kv.first) : 0.0;
+		printf("  %-10s %10.3e %10d %10.3e %10.2f %10.3e %8d\n",
+			kv.first.c_str(), w.error.maxAbs, w.frame, w.error.rms, w.error.psnr, tolerance, w.comparedFrames);
+	}
+	if (missingFrames > 0) {
+		printf("%d fields could not be read from the reference\n", missingFrames);
+	}
+	if (missingFields > 0) {
+		printf("%d fields are not in the reference\n", missingFields);
+	}
+
+	bool pass = !failed && !worst.empty();
+	printf("%s\n", pass ? "PASS: all fields are within tolerance" : "FAIL: fields are outside their tolerance");
+	return pass;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "field_dump.h"
+
+// compares the fields of a run against a reference dump that was recorded with --dump, see field_dump.h.
+// this is how optimizations are validated: record a reference before the change, and compare against it after,
+// so that every change comes with a number for how much it changed the results.
+//
+// for every compared frame and field, the maximum absolute error, the RMS error and the PSNR are printed,
+// along with a hash of the new field, so that bit exact runs are easy to spot. the PSNR uses the largest
+// absolute value in the reference field as the peak.
+// a field fails if its maximum absolute error is above its tolerance, which is 0 unless set,
+// or if the reference does not have it.
+
+struct FieldError {
+	double maxAbs;
+	double rms;
+	double psnr; // infinite if the fields are equal.
+};
+
+FieldError fieldError(const std::vector<float>& reference, const std::vector<float>& data);
+
+class GoldenComparer {
+public:
+	bool open(const std::string& path);
+	bool isOpen() const { return opened; }
+
+	void setTolerance(const std::string& field, double maxAbs);
+
+	// the frames that the reference has, in increasing order.
+	const std::vector<int>& getFrames() const { return frames; }
+	bool hasFrame(int frame) const;
+	bool hasField(const std::string& name) const;
+
+	// names and data of the fields of the current run, in any order.
+	// returns false if any field is outside its tolerance, or is not in the reference.
+	bool compareFrame(int frame, const std::vector<std::string>& names, const std::vector<std::vector<float> >& data);
+
+	// prints the largest errors of every field over all compared frames. returns true if everything was within tolerance.
+	bool printSummary() const;
+
+private:
+	struct Worst {
+		FieldError error;
+		int frame;
+		int comparedFrames;
+	};
+
+	bool opened = false;
+	FieldDumpReader reader;
+	std::vector<int> frames;
+	std::map<std::string, double> tolerances;
+	std::map<std::string, Worst> worst;
+	bool failed = false;
+	int missingFrames = 0;
+	int missingFields = 0;
+};
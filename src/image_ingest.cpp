@@ -0,0 +1,240 @@
+#include "image_ingest.h"
+
+#include "disk_cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define INGEST_SSE
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_JPEG
+#define STBI_ONLY_PNG
+#define STBI_ONLY_HDR
+#include "stb_image.h"
+
+namespace {
+
+// bump this whenever the contents of the cache files change meaning.
+const uint64_t CACHE_VERSION = 1;
+const char CACHE_MAGIC[8] = { 'F', 'L', 'D', 'L', 'I', 'N', 'R', '1' };
+
+std::string cachePath(const std::string& cacheDir, const std::vector<uint8_t>& file, int width, int height) {
+	uint64_t h = fnv1a(file.data(), file.size());
+	uint64_t params[3] = { CACHE_VERSION, (uint64_t)width, (uint64_t)height };
+	h = fnv1a(params, sizeof(params), h);
+	return cacheFilePath(cacheDir, h, "lin");
+}
+
+bool readCache(const std::string& path, int width, int height, LinearImage& out) {
+	std::vector<uint8_t> payload;
+	if (!readCacheFile(path, CACHE_MAGIC, payload) || payload.size() != 8 + (size_t)width * height * 4 * sizeof(float)) {
+		return false;
+	}
+	int32_t size[2];
+	memcpy(size, payload.data(), 8);
+	if (size[0] != width || size[1] != height) {
+		return false;
+	}
+	out.width = width;
+	out.height = height;
+	out.rgba.resize((size_t)width * height * 4);
+	memcpy(out.rgba.data(), payload.data() + 8, out.rgba.size() * sizeof(float));
+	return true;
+}
+
+void writeCache(const std::string& cacheDir, const std::string& path, const LinearImage& img) {
+	std::vector<uint8_t> payload(8 + img.rgba.size() * sizeof(float));
+	int32_t size[2] = { img.width, img.height };
+	memcpy(payload.data(), size, 8);
+	memcpy(payload.data() + 8, img.rgba.data(), img.rgba.size() * sizeof(float));
+	writeCacheFile(cacheDir, path, CACHE_MAGIC, payload.data(), payload.size());
+}
+
+// decode into linear RGBA floats, rows top to bottom.
+bool decode(const std::vector<uint8_t>& file, int* w, int* h, std::vector<float>& out) {
+	int n;
+	if (stbi_is_hdr_from_memory(file.data(), (int)file.size())) {
+		// HDR files are already linear.
+		float* pixels = stbi_loadf_from_memory(file.data(), (int)file.size(), w, h, &n, 4);
+		if (pixels == nullptr) {
+			return false;
+		}
+		out.assign(pixels, pixels + (size_t)(*w) * (*h) * 4);
+		stbi_image_free(pixels);
+		return true;
+	}
+
+	stbi_uc* pixels = stbi_load_from_memory(file.data(), (int)file.size(), w, h, &n, 4);
+	if (pixels == nullptr) {
+		return false;
+	}
+
+	// same gamma of 2.2 that the visualization shader undoes.
+	float toLinear[256];
+	for (int i = 0; i < 256; ++i) {
+		toLinear[i] = powf(float(i) / 255.0f, 2.2f);
+	}
+
+	size_t count = (size_t)(*w) * (*h);
+	out.resize(count * 4);
+	for (size_t i = 0; i < count; ++i) {
+		out[4 * i + 0] = toLinear[pixels[4 * i + 0]];
+		out[4 * i + 1] = toLinear[pixels[4 * i + 1]];
+		out[4 * i + 2] = toLinear[pixels[4 * i + 2]];
+		out[4 * i + 3] = float(pixels[4 * i + 3]) / 255.0f;
+	}
+	stbi_image_free(pixels);
+	return true;
+}
+
+// weights of a tent filter, that is widened when downsampling, so that every source pixel contributes.
+// when upsampling, this is the same as bilinear filtering.
+struct FilterTaps {
+	std::vector<int> count;  // number of taps, per destination index.
+	std::vector<int> offset; // into indices and weights, per destination index.
+	std::vector<int> indices;
+	std::vector<float> weights;
+};
+
+FilterTaps computeTaps(int srcN, int dstN) {
+	FilterTaps taps;
+	float scale = float(srcN) / float(dstN);
+	float radius = std::max(1.0f, scale);
+
+	for (int i = 0; i < dstN; ++i) {
+		float center = (float(i) + 0.5f) * scale - 0.5f;
+		int j0 = (int)ceilf(center - radius);
+		int j1 = (int)floorf(center + radius);
+
+		taps.offset.push_back((int)taps.indices.size());
+		float sum = 0.0f;
+		for (int j = j0; j <= j1; ++j) {
+			float w = 1.0f - fabsf(float(j) - center) / radius;
+			if (w <= 0.0f) {
+				continue;
+			}
+			taps.indices.push_back(std::min(std::max(j, 0), srcN - 1));
+			taps.weights.push_back(w);
+			sum += w;
+		}
+		taps.count.push_back((int)taps.indices.size() - taps.offset.back());
+		for (int k = taps.offset.back(); k < (int)taps.indices.size(); ++k) {
+			taps.weights[k] /= sum;
+		}
+	}
+	return taps;
+}
+
+// dst[i] += w * src[i], for n floats.
+inline void accumulate(float* dst, const float* src, float w, size_t n) {
+	size_t i = 0;
+#ifdef INGEST_SSE
+	__m128 vw = _mm_set1_ps(w);
+	for (; i + 4 <= n; i += 4) {
+		__m128 d = _mm_loadu_ps(dst + i);
+		__m128 s = _mm_loadu_ps(src + i);
+		_mm_storeu_ps(dst + i, _mm_add_ps(d, _mm_mul_ps(s, vw)));
+	}
+#endif
+	for (; i < n; ++i) {
+		dst[i] += w * src[i];
+	}
+}
+
+// run f(begin, end) over [0, n), split over all hardware threads.
+template <typename F>
+void parallelFor(int n, F f) {
+	int nThreads = std::max(1, std::min((int)std::thread::hardware_concurrency(), n));
+	std::vector<std::thread> threads;
+	for (int i = 1; i < nThreads; ++i) {
+		threads.push_back(std::thread(f, n * i / nThreads, n * (i + 1) / nThreads));
+	}
+	f(0, n / nThreads);
+	for (std::thread& t : threads) {
+		t.join();
+	}
+}
+
+// separable resampling of RGBA rows. the vertical pass also flips the image,
+// since decoded images are stored top to bottom, and textures bottom to top.
+void resample(const std::vector<float>& src, int srcW, int srcH, int dstW, int dstH, std::vector<float>& dst) {
+	FilterTaps xTaps = computeTaps(srcW, dstW);
+	FilterTaps yTaps = computeTaps(srcH, dstH);
+
+	std::vector<float> tmp((size_t)dstW * srcH * 4);
+	parallelFor(srcH, [&](int yBegin, int yEnd) {
+		for (int y = yBegin; y < yEnd; ++y) {
+			const float* srcRow = &src[(size_t)y * srcW * 4];
+			float* tmpRow = &tmp[(size_t)y * dstW * 4];
+			for (int x = 0; x < dstW; ++x) {
+				float* d = tmpRow + x * 4;
+				d[0] = d[1] = d[2] = d[3] = 0.0f;
+				for (int k = xTaps.offset[x]; k < xTaps.offset[x] + xTaps.count[x]; ++k) {
+					accumulate(d, srcRow + xTaps.indices[k] * 4, xTaps.weights[k], 4);
+				}
+			}
+		}
+	});
+
+	dst.assign((size_t)dstW * dstH * 4, 0.0f);
+	parallelFor(dstH, [&](int yBegin, int yEnd) {
+		for (int y = yBegin; y < yEnd; ++y) {
+			float* dstRow = &dst[(size_t)(dstH - 1 - y) * dstW * 4];
+			for (int k = yTaps.offset[y]; k < yTaps.offset[y] + yTaps.count[y]; ++k) {
+				accumulate(dstRow, &tmp[(size_t)yTaps.indices[k] * dstW * 4], yTaps.weights[k], (size_t)dstW * 4);
+			}
+		}
+	});
+}
+
+} // namespace
+
+bool ingestImage(const std::string& path, int width, int height, const std::string& cacheDir, LinearImage& out) {
+	std::vector<uint8_t> file;
+	if (!readFile(path, file)) {
+		printf("Could not open %s\n", path.c_str());
+		return false;
+	}
+
+	std::string cacheFile;
+	if (cacheDir != "") {
+		cacheFile = cachePath(cacheDir, file, width, height);
+		if (readCache(cacheFile, width, height, out)) {
+			return true;
+		}
+	}
+
+	int srcW, srcH;
+	std::vector<float> src;
+	if (!decode(file, &srcW, &srcH, src)) {
+		printf("Could not decode %s: %s\n", path.c_str(), stbi_failure_reason());
+		return false;
+	}
+
+	out.width = width;
+	out.height = height;
+	resample(src, srcW, srcH, width, height, out.rgba);
+
+	if (cacheDir != "") {
+		writeCache(cacheDir, cacheFile, out);
+	}
+	return true;
+}
+
+std::future<LinearImage> ingestImageAsync(const std::string& path, int width, int height, const std::string& cacheDir) {
+	return std::async(std::launch::async, [=]() {
+		LinearImage img;
+		if (!ingestImage(path, width, height, cacheDir, img)) {
+			img.width = img.height = 0;
+		}
+		return img;
+	});
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <future>
+#include <string>
+#include <vector>
+
+// loading of the images that are written into the color field.
+//
+// PNG, JPEG and HDR files are decoded, converted to linear color, and resampled to the size of
+// the simulation grid, all on the CPU. the resampling is spread over all hardware threads,
+// and uses SSE where available. the result is cached on disk, keyed by a hash of the file contents
+// and the grid size, so that the next start only has to read the cache file and upload it.
+
+struct LinearImage {
+	int width;
+	int height;
+	// RGBA, rows stored bottom to top like OpenGL textures.
+	std::vector<float> rgba;
+};
+
+// cacheDir may be empty, which disables the cache.
+bool ingestImage(const std::string& path, int width, int height, const std::string& cacheDir, LinearImage& out);
+
+// same as ingestImage(), but on a separate thread. an empty image is returned on failure.
+std::future<LinearImage> ingestImageAsync(const std::string& path, int width, int height, const std::string& cacheDir);
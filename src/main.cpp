@@ -4,19 +4,75 @@
 #include <string>
 
 #include <vector>
+#include <algorithm>
+#include <array>
+#include <map>
 #include <string>
+#include <unordered_map>
 
 #include <math.h>
 
+#include <atomic>
 #include <chrono>
+#include <functional>
 #include <thread>
 
-#define STB_IMAGE_IMPLEMENTATION
-#define STBI_ONLY_JPEG
-#include "stb_image.h"
+#include "diagnostics.h"
+#include "disk_cache.h"
+#include "exr_writer.h"
+#include "field_dump.h"
+#include "gl_debug_log.h"
+#include "golden_compare.h"
+#include "image_ingest.h"
+#include "pass_profiler.h"
+#include "quality_governor.h"
+#include "render_graph.h"
+#include "shader_library.h"
+#include "trace_recorder.h"
 
 #include <glad/glad.h>
 #define GL_DEBUG_SOURCE_APPLICATION       0x824A
+// KHR_parallel_shader_compile/ARB_parallel_shader_compile, which our GLAD does not load.
+#define GL_COMPLETION_STATUS_KHR           0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+// ARB_get_program_binary, which our GLAD does not load either.
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH           0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS      0x87FE
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+// ARB_timer_query, which is core in 3.3, but our GLAD only loads 3.2.
+#define GL_TIME_ELAPSED                    0x88BF
+#define GL_TIMESTAMP                       0x8E28
+typedef void (APIENTRYP PFNGLGETQUERYOBJECTUI64VPROC)(GLuint id, GLenum pname, GLuint64 *params);
+typedef void (APIENTRYP PFNGLQUERYCOUNTERPROC)(GLuint id, GLenum target);
+// ARB_texture_storage(core in 4.2) and ARB_invalidate_subdata(core in 4.3).
+#define GL_COLOR                           0x1800
+#define GL_DEPTH                           0x1801
+#define GL_STENCIL                         0x1802
+typedef void (APIENTRYP PFNGLTEXSTORAGE2DPROC)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+typedef void (APIENTRYP PFNGLTEXSTORAGE3DPROC)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth);
+typedef void (APIENTRYP PFNGLINVALIDATETEXIMAGEPROC)(GLuint texture, GLint level);
+typedef void (APIENTRYP PFNGLINVALIDATEFRAMEBUFFERPROC)(GLenum target, GLsizei numAttachments, const GLenum *attachments);
+// ARB_buffer_storage(core in 4.4).
+#define GL_MAP_PERSISTENT_BIT              0x0040
+#define GL_MAP_COHERENT_BIT                0x0080
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+// compute shaders and image load/store, core in 4.3.
+#define GL_COMPUTE_SHADER                  0x91B9
+#define GL_COMPUTE_WORK_GROUP_SIZE         0x8267
+#define GL_TEXTURE_FETCH_BARRIER_BIT       0x00000008
+#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT 0x00000020
+#define GL_PIXEL_BUFFER_BARRIER_BIT        0x00000080
+#define GL_TEXTURE_UPDATE_BARRIER_BIT      0x00000100
+#define GL_FRAMEBUFFER_BARRIER_BIT         0x00000400
+typedef void (APIENTRYP PFNGLDISPATCHCOMPUTEPROC)(GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z);
+typedef void (APIENTRYP PFNGLBINDIMAGETEXTUREPROC)(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format);
+typedef void (APIENTRYP PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+// ARB_copy_image(core in 4.3).
+typedef void (APIENTRYP PFNGLCOPYIMAGESUBDATAPROC)(GLuint srcName, GLenum srcTarget, GLint srcLevel, GLint srcX, GLint srcY, GLint srcZ,
+	GLuint dstName, GLenum dstTarget, GLint dstLevel, GLint dstX, GLint dstY, GLint dstZ, GLsizei srcWidth, GLsizei srcHeight, GLsizei srcDepth);
 #include <GLFW/glfw3.h>
 
 inline void checkOpenGLError(const char* stmt, const char* fname, int line)
@@ -27,16 +83,28 @@ inline void checkOpenGLError(const char* stmt, const char* fname, int line)
 	}
 }
 
+// in debug builds, GL errors are checked after every call, unless the KHR_debug callback reports them, see initGlDebug().
+// calling glGetError() after every call serializes the driver, so with the callback it is only called at the dpush()/dpop() scopes.
+bool checkEveryGlCall = true;
+
+// every call through GL_C is counted, and so are the calls that the state cache skipped, see GlStateCache.
+long long glCalls = 0;
+long long glCallsSkipped = 0;
+
 #ifdef NDEBUG
 // helper macro that checks for GL errors.
 #define GL_C(stmt) do {					\
 	stmt;						\
+	glCalls++;					\
     } while (0)
 #else
 // helper macro that checks for GL errors.
 #define GL_C(stmt) do {					\
 	stmt;						\
-	checkOpenGLError(#stmt, __FILE__, __LINE__);	\
+	glCalls++;					\
+	if (checkEveryGlCall) {				\
+		checkOpenGLError(#stmt, __FILE__, __LINE__);	\
+	}						\
     } while (0)
 #endif
 
@@ -52,6 +120,15 @@ inline char* getShaderLogInfo(GLuint shader) {
 	return infoLog;
 }
 
+inline char* getProgramLogInfo(GLuint program) {
+	GLint len;
+	GLsizei actualLen;
+	GL_C(glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len));
+	char* infoLog = new char[len];
+	GL_C(glGetProgramInfoLog(program, len, &actualLen, infoLog));
+	return infoLog;
+}
+
 inline GLuint createShaderFromString(const std::string& shaderSource, const GLenum shaderType) {
 	GLuint shader;
 
@@ -60,55 +137,297 @@ inline GLuint createShaderFromString(const std::string& shaderSource, const GLen
 	GL_C(glShaderSource(shader, 1, &c_str, NULL));
 	GL_C(glCompileShader(shader));
 
+	return shader;
+}
+
+// prints the errors of a shader that did not compile. the numbers in front of the line numbers are the files.
+inline bool checkShader(GLuint shader, const ShaderSource& shaderSource) {
 	GLint compileStatus;
 	GL_C(glGetShaderiv(shader, GL_COMPILE_STATUS, &compileStatus));
 	if (compileStatus != GL_TRUE) {
-		printf("Could not compile shader\n\n%s \n\n%s\n", shaderSource.c_str(),
-			getShaderLogInfo(shader));
-		exit(1);
+		printf("Could not compile shader %s\n\n%s\n", shaderSource.files[0].c_str(), getShaderLogInfo(shader));
+		for (size_t i = 0; i < shaderSource.files.size(); ++i) {
+			printf("  %d: %s\n", (int)i, shaderSource.files[i].c_str());
+		}
+		return false;
 	}
+	return true;
+}
 
-	return shader;
+// directory of the on-disk caches, see disk_cache.h. an empty string disables caching.
+std::string cacheDir = "fluid_cache";
+
+// linked programs are cached on disk, if the driver supports ARB_get_program_binary.
+// the cache is keyed by the shader sources and the driver, so a driver update just causes a recompile.
+PFNGLGETPROGRAMBINARYPROC pglGetProgramBinary = nullptr;
+PFNGLPROGRAMBINARYPROC pglProgramBinary = nullptr;
+PFNGLPROGRAMPARAMETERIPROC pglProgramParameteri = nullptr;
+std::string driverString = "";
+const char PROGRAM_CACHE_MAGIC[8] = { 'F', 'L', 'D', 'P', 'B', 'I', 'N', '1' };
+
+inline void initProgramBinaryCache() {
+	GLint nFormats = 0;
+	if (glfwExtensionSupported("GL_ARB_get_program_binary")) {
+		GL_C(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nFormats));
+	}
+	if (nFormats == 0) {
+		return;
+	}
+	pglGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+	pglProgramBinary = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+	pglProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
+
+	driverString = std::string((const char*)glGetString(GL_VENDOR)) + "\n" +
+		(const char*)glGetString(GL_RENDERER) + "\n" + (const char*)glGetString(GL_VERSION);
+}
+
+// the fields are allocated with immutable storage, and their old contents are discarded instead of cleared
+// before a pass overwrites them, if the driver can. both only tell the driver what we are going to do,
+// so without them everything works the same, just with mutable textures and nothing discarded.
+PFNGLTEXSTORAGE2DPROC pglTexStorage2D = nullptr;
+PFNGLTEXSTORAGE3DPROC pglTexStorage3D = nullptr;
+PFNGLINVALIDATETEXIMAGEPROC pglInvalidateTexImage = nullptr;
+PFNGLINVALIDATEFRAMEBUFFERPROC pglInvalidateFramebuffer = nullptr;
+
+inline bool hasGlVersion(int major, int minor) {
+	return GLVersion.major > major || (GLVersion.major == major && GLVersion.minor >= minor);
+}
+
+inline void initTextureStorage() {
+	if (hasGlVersion(4, 2) || glfwExtensionSupported("GL_ARB_texture_storage")) {
+		pglTexStorage2D = (PFNGLTEXSTORAGE2DPROC)glfwGetProcAddress("glTexStorage2D");
+		pglTexStorage3D = (PFNGLTEXSTORAGE3DPROC)glfwGetProcAddress("glTexStorage3D");
+	}
+	if (hasGlVersion(4, 3) || glfwExtensionSupported("GL_ARB_invalidate_subdata")) {
+		pglInvalidateTexImage = (PFNGLINVALIDATETEXIMAGEPROC)glfwGetProcAddress("glInvalidateTexImage");
+		pglInvalidateFramebuffer = (PFNGLINVALIDATEFRAMEBUFFERPROC)glfwGetProcAddress("glInvalidateFramebuffer");
+	}
 }
 
-inline GLuint loadNormalShader(const std::string& vsSource, const std::string& fsShader) {
+inline bool programCacheEnabled() {
+	return cacheDir != "" && pglGetProgramBinary != nullptr;
+}
 
-	std::string prefix = "";
-	prefix = "#version 330\n";
+inline std::string programCachePath(const std::string& vsSource, const std::string& fsSource) {
+	uint64_t h = fnv1a(driverString);
+	h = fnv1a(vsSource, h);
+	h = fnv1a(fsSource, h);
+	return cacheFilePath(cacheDir, h, "bin");
+}
 
-	GLuint vs = createShaderFromString(prefix + vsSource, GL_VERTEX_SHADER);
-	GLuint fs = createShaderFromString(prefix + fsShader, GL_FRAGMENT_SHADER);
+// returns 0 if there is no cached binary, or if the driver rejects it.
+inline GLuint loadCachedProgram(const std::string& path) {
+	std::vector<uint8_t> payload;
+	if (!readCacheFile(path, PROGRAM_CACHE_MAGIC, payload) || payload.size() <= sizeof(GLenum)) {
+		return 0;
+	}
+	GLenum format;
+	memcpy(&format, payload.data(), sizeof(GLenum));
 
-	GLuint shader = glCreateProgram();
-	glAttachShader(shader, vs);
-	glAttachShader(shader, fs);
-	glLinkProgram(shader);
+	GLuint program = glCreateProgram();
+	pglProgramBinary(program, format, payload.data() + sizeof(GLenum), (GLsizei)(payload.size() - sizeof(GLenum)));
 
 	GLint Result;
-	glGetProgramiv(shader, GL_LINK_STATUS, &Result);
+	glGetProgramiv(program, GL_LINK_STATUS, &Result);
+	// the GL error of a rejected binary is expected, and should not be reported.
+	while (glGetError() != GL_NO_ERROR) {
+	}
 	if (Result == GL_FALSE) {
-		printf("Could not link shader \n\n%s\n", getShaderLogInfo(shader));
-		exit(1);
+		glDeleteProgram(program);
+		removeCacheFile(path);
+		return 0;
+	}
+	return program;
+}
+
+inline void saveCachedProgram(GLuint program, const std::string& path) {
+	GLint len = 0;
+	GL_C(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &len));
+	if (len == 0) {
+		return;
 	}
+	std::vector<uint8_t> payload(sizeof(GLenum) + len);
+	GLenum format;
+	GL_C(pglGetProgramBinary(program, len, nullptr, &format, payload.data() + sizeof(GLenum)));
+	memcpy(payload.data(), &format, sizeof(GLenum));
+	writeCacheFile(cacheDir, path, PROGRAM_CACHE_MAGIC, payload.data(), payload.size());
+}
 
-	glDetachShader(shader, vs);
-	glDetachShader(shader, fs);
+// programs that were submitted for compilation, but whose status has not been checked yet.
+struct PendingProgram {
+	GLuint program;
+	GLuint vs; // the compute shader, in a compute program. 0 if the program came from the cache.
+	GLuint gs; // 0 unless the program has a geometry shader.
+	GLuint fs; // 0 in a compute program.
+	ShaderSource vsSource;
+	ShaderSource gsSource;
+	ShaderSource fsSource;
+	std::string cachePath;
+};
+std::vector<PendingProgram> pendingPrograms;
 
-	glDeleteShader(vs);
-	glDeleteShader(fs);
+// with KHR_parallel_shader_compile, we can ask whether a program is compiled without waiting for it.
+bool parallelShaderCompile = false;
 
-	return shader;
+// the textures are texture arrays only when the fields have more than one layer, in an ensemble or with a tiled color field.
+// otherwise they are plain 2D textures, since the samplers of some drivers filter the layers of an array
+// a little differently, and a single simulation should give exactly the same fields as ever.
+// the shaders get LAYERED_FIELDS defined for arrays, see shaders/layers.glsl. set by initGlfw().
+bool layeredFields = false;
+
+inline GLenum textureTarget() {
+	return layeredFields ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+}
+
+// this only submits the program to the driver. querying the status would make us wait for the compiler,
+// so that is postponed to checkProgram(), and the driver is free to compile all programs in parallel.
+// a program without a fragment shader is a compute program, which needs GL 4.3, see initComputeBackend().
+// the geometry shader is optional, and left out when gsSource has no files.
+inline PendingProgram submitProgram(const ShaderSource& vsSource, const ShaderSource& gsSource, const ShaderSource& fsSource) {
+	bool compute = fsSource.files.empty();
+	bool geometry = !gsSource.files.empty();
+
+	PendingProgram p;
+	p.vsSource = vsSource;
+	p.gsSource = gsSource;
+	p.fsSource = fsSource;
+	std::string defines = layeredFields ? "#define LAYERED_FIELDS\n" : "";
+	p.vsSource.text = (compute ? "#version 430\n" : "#version 330\n") + defines + vsSource.text;
+	if (geometry) {
+		p.gsSource.text = "#version 330\n" + defines + gsSource.text;
+	}
+	if (!compute) {
+		p.fsSource.text = "#version 330\n" + defines + fsSource.text;
+	}
+	p.vs = 0;
+	p.gs = 0;
+	p.fs = 0;
+
+	if (programCacheEnabled()) {
+		p.cachePath = programCachePath(p.vsSource.text, p.gsSource.text + p.fsSource.text);
+		p.program = loadCachedProgram(p.cachePath);
+		if (p.program != 0) {
+			return p;
+		}
+	}
+
+	p.vs = createShaderFromString(p.vsSource.text, compute ? GL_COMPUTE_SHADER : GL_VERTEX_SHADER);
+	if (geometry) {
+		p.gs = createShaderFromString(p.gsSource.text, GL_GEOMETRY_SHADER);
+	}
+	if (!compute) {
+		p.fs = createShaderFromString(p.fsSource.text, GL_FRAGMENT_SHADER);
+	}
+
+	p.program = glCreateProgram();
+	if (programCacheEnabled()) {
+		GL_C(pglProgramParameteri(p.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+	}
+	glAttachShader(p.program, p.vs);
+	if (geometry) {
+		glAttachShader(p.program, p.gs);
+	}
+	if (!compute) {
+		glAttachShader(p.program, p.fs);
+	}
+	glLinkProgram(p.program);
+	return p;
+}
+
+// waits for a submitted program, and prints the errors if it failed. the shaders are not needed after this either way.
+inline bool checkProgram(PendingProgram& p) {
+	if (p.vs == 0) {
+		return true;
+	}
+
+	GLint Result;
+	glGetProgramiv(p.program, GL_LINK_STATUS, &Result);
+	if (Result == GL_FALSE) {
+		bool compiled = checkShader(p.vs, p.vsSource);
+		compiled = (p.gs == 0 || checkShader(p.gs, p.gsSource)) && compiled;
+		compiled = (p.fs == 0 || checkShader(p.fs, p.fsSource)) && compiled;
+		if (compiled) {
+			printf("Could not link shader %s\n\n%s\n", p.vsSource.files[0].c_str(), getProgramLogInfo(p.program));
+		}
+	}
+
+	glDetachShader(p.program, p.vs);
+	glDeleteShader(p.vs);
+	if (p.gs != 0) {
+		glDetachShader(p.program, p.gs);
+		glDeleteShader(p.gs);
+	}
+	if (p.fs != 0) {
+		glDetachShader(p.program, p.fs);
+		glDeleteShader(p.fs);
+	}
+	p.vs = 0;
+	p.gs = 0;
+	p.fs = 0;
+
+	if (Result == GL_TRUE && p.cachePath != "") {
+		saveCachedProgram(p.program, p.cachePath);
+	}
+	return Result == GL_TRUE;
+}
+
+// wait for all submitted programs, and exit if any of them failed.
+inline void finishPrograms() {
+	bool ok = true;
+	for (PendingProgram& p : pendingPrograms) {
+		ok = checkProgram(p) && ok;
+	}
+	if (!ok) {
+		exit(1);
+	}
+	pendingPrograms.clear();
 }
 
 GLFWwindow* window;
 
-const int WINDOW_WIDTH = 256 * 4;
-const int WINDOW_HEIGHT = 256 * 4;
+// size of the window, which is also the resolution that the result is presented at.
+int windowWidth = 256 * 4;
+int windowHeight = 256 * 4;
 
 GLuint vao;
 
 int fbWidth, fbHeight;
 
+// size of the simulation grid, that is, of the velocity and pressure fields. by default the same as the framebuffer,
+// but it can be changed on the command line, and at runtime with resizeGrid().
+int gridWidth, gridHeight;
+int requestedGridWidth = 0;
+int requestedGridHeight = 0;
+
+// size of the color(dye) field. the color only has to be advected, which is cheap compared to the pressure solve,
+// so it can have a much higher resolution than the grid. by default the same as the grid.
+int dyeWidth, dyeHeight;
+int requestedDyeWidth = 0;
+int requestedDyeHeight = 0;
+
+// a color field that is larger than the largest texture is split into tiles, see initDyeTiles(), so that it can be
+// as large as the memory allows, for print resolution output. the tiles are the layers of the textures of the color field,
+// dyeTilesX * dyeTilesY of them per member, row by row, and every tile has a halo of dyeHalo cells around its
+// dyeTileWidth x dyeTileHeight cells, with copies of the cells of its neighbours, see exchangeDyeHalos().
+// the passes that write the color field draw every tile, and the shaders read the field across the tiles through the halos,
+// see shaders/dye.glsl. a color field that fits into a texture is a single tile, without a halo.
+// the grid is not tiled. it is the color field that needs the resolution, and the grid under it can stay small.
+int dyeTileLimit = 0; // --dye-tile, the largest size of a texture of a tile. 0 is GL_MAX_TEXTURE_SIZE.
+int dyeTilesX = 1;
+int dyeTilesY = 1;
+int dyeTileWidth, dyeTileHeight;
+int dyeHalo = 0;
+int dyeTextureWidth, dyeTextureHeight; // the size of a tile with its halo.
+PFNGLCOPYIMAGESUBDATAPROC pglCopyImageSubData = nullptr; // for the halos, if the driver has it.
+
+// --ensemble runs ensembleSize simulations of the same scene side by side. every field is a texture array, with a layer
+// per member, and every pass covers all members at once, with an instance per member that the geometry shader
+// sends to its layer. so the number of draw calls does not grow with the members, only the work of every draw.
+// the members differ in the noise of the emitters, and member m adds 1 + m * ensembleForce times the force.
+// member 0 is the plain simulation, and the window, the diagnostics and --compare against a single simulation use it.
+int ensembleSize = 1;
+float ensembleForce = 0.1f;
+
 bool done = false;
 
 struct FullscreenVertex {
@@ -119,19 +438,18 @@ GLuint fullscreenVertexVbo;
 GLuint advectShader;
 GLuint asuTexLocation;
 GLuint assTexLocation;
+GLuint asTiledDyeLocation;
 
 GLuint jacobiShader;
 GLuint jsxTexLocation;
 GLuint jsbTexLocation;
-GLuint jsAlphaLocation;
-GLuint jsBetaLocation;
 
 GLuint divergenceShader;
 GLuint dswTexLocation;
 
 GLuint visShader;
 GLuint vsTexLocation;
-GLuint vsBlendLocation;
+GLuint vsBicubicLocation;
 
 GLuint gradientSubtractionShader;
 GLuint gsspTexLocation;
@@ -139,28 +457,89 @@ GLuint gsswTexLocation;
 
 GLuint forceShader;
 GLuint fswTexLocation;
-GLuint fsCounterLocation;
-GLuint fsSimLocation;
 
 GLuint addColorShader;
 GLuint accTexLocation;
-GLuint acCounterLocation;
-GLuint acSimLocation;
+GLuint acTiledDyeLocation;
 
 GLuint writeTexShader;
 GLuint wtcTexLocation;
 GLuint wtOffsetLocation;
 GLuint wtSizeLocation;
+GLuint wtTiledDyeLocation;
+
+GLuint resampleShader;
+GLuint rssTexLocation;
+GLuint rsScaleLocation;
+
+// the simulation passes run either as fragment shaders that draw a fullscreen quad, or as compute shaders,
+// which write their result with imageStore(). see --backend.
+enum Backend {
+	BACKEND_FRAGMENT,
+	BACKEND_COMPUTE
+};
+Backend backend = BACKEND_FRAGMENT;
+
+// every kernel declares its group size in its shader, and it is read back from the program, see getUniformLocations().
+struct ComputeKernel {
+	GLuint program;
+	int groupWidth;
+	int groupHeight;
+	GLint tiledDyeLocation; // of uTiledDye, which the kernels that write the color field set, see shaders/dye.glsl.
+};
+ComputeKernel advectKernel;
+ComputeKernel divergenceKernel;
+ComputeKernel jacobiKernel;
+ComputeKernel gradientSubtractionKernel;
+ComputeKernel forceKernel;
+ComputeKernel addColorKernel;
+
+PFNGLDISPATCHCOMPUTEPROC pglDispatchCompute = nullptr;
+PFNGLBINDIMAGETEXTUREPROC pglBindImageTexture = nullptr;
+PFNGLMEMORYBARRIERPROC pglMemoryBarrier = nullptr;
+
+// the compute backend needs GL 4.3. we only ask for a 3.3 context, but drivers give us the newest version they have.
+void initComputeBackend() {
+	if (backend != BACKEND_COMPUTE) {
+		return;
+	}
+	if (!hasGlVersion(4, 3)) {
+		printf("The compute backend needs OpenGL 4.3, but the context is %d.%d, so the fragment backend is used\n",
+			GLVersion.major, GLVersion.minor);
+		backend = BACKEND_FRAGMENT;
+		return;
+	}
+	pglDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)glfwGetProcAddress("glDispatchCompute");
+	pglBindImageTexture = (PFNGLBINDIMAGETEXTUREPROC)glfwGetProcAddress("glBindImageTexture");
+	pglMemoryBarrier = (PFNGLMEMORYBARRIERPROC)glfwGetProcAddress("glMemoryBarrier");
+}
 
-GLuint fbo0;
+GLuint reduceShader;
+GLuint rdaTexLocation;
+GLuint rdbTexLocation;
+GLuint rdcTexLocation;
+GLuint rdModeLocation;
+GLuint rdSizeLocation;
+GLuint rdBlockLocation;
+
+GLuint tileActivityShader;
+GLuint tawTexLocation;
+GLuint tacTexLocation;
+GLuint taThresholdLocation;
+GLuint taTileCountLocation;
+
+GLuint tileDilationShader;
+GLuint tdaTexLocation;
+GLuint tdRadiusLocation;
+
+// the fields of the simulation. they are only names for the physical textures that the render graph of
+// the simulation step hands out, and several of them can share the same texture, see compileStepGraph().
 
 // velocity tex.
-GLuint uBegTex;
-GLuint uEndTex;
+GLuint uTex;
 
 // color tex
-GLuint cBegTex;
-GLuint cEndTex;
+GLuint cTex;
 GLuint cTempTex;
 
 GLuint wTex;
@@ -168,12 +547,15 @@ GLuint wTempTex;
 GLuint wDivergenceTex;
 GLuint pTempTex[2];
 GLuint pTex;
-GLuint uEndTempTex;
-GLuint outTex;
 
 GLuint monaTex;
 GLuint screamTex;
 
+// the images written into the color field. they are looked for in the working directory,
+// and in its parent directory. see image_ingest.h
+std::string monaPath = "smallmona.jpg";
+std::string screamPath = "smallscream.jpg";
+
 enum SimulationStage {
 	CIRCLE_SIM = 0,
 	FADE_IN_MONA_LISA_SIM = 1,
@@ -187,6 +569,176 @@ enum SimulationStage {
 
 SimulationStage curSim = CIRCLE_SIM;
 
+// we use this simple counter for progressing the state of the the simulation. it starts over at every stage.
+int icounter = 0;
+// keeps the simulation in curSim, instead of moving on to the next stage. used for benchmarking.
+bool stageLocked = false;
+
+// the knobs that trade simulation quality for speed. these are the defaults, and the governor changes them
+// at runtime if a target frame time was given, see quality_governor.h
+QualitySettings quality = { 40, 1, 0 };
+QualityBounds qualityBounds = { 10, 40, 1, 1, 2 };
+double targetFrameMs = 0.0;
+QualityGovernor governor;
+// the grid that gridLevel 0 corresponds to.
+int baseGridWidth, baseGridHeight;
+
+// GPU time of whole frames, measured with GL_TIME_ELAPSED queries that are used round robin.
+// a result is only read once it is available, so measuring never stalls the pipeline.
+const int FRAME_QUERY_COUNT = 4;
+GLuint frameQueries[FRAME_QUERY_COUNT];
+int frameQueriesIssued = 0;
+int frameQueriesRead = 0;
+PFNGLGETQUERYOBJECTUI64VPROC pglGetQueryObjectui64v = nullptr;
+
+// number of frames simulated so far. unlike the counter in renderFrame(), this one never resets.
+int frameCount = 0;
+
+// velocity, pressure and color can be recorded every dumpEvery frames, see field_dump.h
+std::string dumpPath = "";
+int dumpEvery = 10;
+const int DUMP_TILE_SIZE = 64;
+FieldDumpWriter fieldDump;
+
+// velocity, pressure and color can also be exported as half float EXR images, see exr_writer.h
+std::string exrPrefix = "";
+int exrEvery = 1;
+ExrExporter exrExporter;
+
+// the fields can be compared against a reference dump, to check what an optimization did to the results. see golden_compare.h
+std::string comparePath = "";
+GoldenComparer golden;
+
+// no visible window, and no frame rate limit.
+bool headless = false;
+
+// debug output is on by default in debug builds, and --gl-debug turns it on in release builds.
+#ifdef NDEBUG
+bool glDebug = false;
+#else
+bool glDebug = true;
+#endif
+bool checkScopeGlErrors = false;
+GlDebugLog glDebugLog;
+
+// the dpush() scopes that are open. the innermost one is also published to the debug callback,
+// which may run on a thread of the driver.
+std::vector<const char*> glScopes = { "no scope" };
+std::atomic<const char*> glScope("no scope");
+
+const char* debugSourceName(GLenum source) {
+	switch (source) {
+	case GL_DEBUG_SOURCE_API: return "api";
+	case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+	case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+	case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+	case GL_DEBUG_SOURCE_APPLICATION: return "application";
+	default: return "other";
+	}
+}
+
+const char* debugTypeName(GLenum type) {
+	switch (type) {
+	case GL_DEBUG_TYPE_ERROR: return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+	case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+	default: return "other";
+	}
+}
+
+const char* debugSeverityName(GLenum severity) {
+	switch (severity) {
+	case GL_DEBUG_SEVERITY_HIGH: return "high";
+	case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+	case GL_DEBUG_SEVERITY_LOW: return "low";
+	default: return "notification";
+	}
+}
+
+void APIENTRY onGlDebugMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+	const GLchar* message, const void* /*userParam*/) {
+	glDebugLog.push(debugSeverityName(severity), debugSourceName(source), debugTypeName(type), id,
+		glScope.load(std::memory_order_relaxed), message, length);
+}
+
+// the debug output is asynchronous, so the callback does not slow down the GL calls. notifications are left out,
+// they are mostly about the debug groups of dpush().
+void initGlDebug() {
+	if (!glDebug) {
+		return;
+	}
+	if (GLAD_GL_KHR_debug && glDebugMessageCallback != nullptr) {
+		glDebugLog.start();
+		GL_C(glEnable(GL_DEBUG_OUTPUT));
+		GL_C(glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE));
+		GL_C(glDebugMessageCallback(onGlDebugMessage, nullptr));
+		checkEveryGlCall = false;
+	}
+	else {
+		printf("KHR_debug is not supported, so GL errors are only found with glGetError()\n");
+	}
+
+#ifdef NDEBUG
+	checkScopeGlErrors = true;
+#else
+	checkScopeGlErrors = !checkEveryGlCall;
+#endif
+}
+
+// report the errors that glGetError() has collected since the last check. where says which scope boundary this is.
+void checkGlErrorsAt(const char* where, const char* scope) {
+	// there can be several error flags, but stop at some point, in case the context was lost.
+	for (int i = 0; i < 8; ++i) {
+		GLenum err = glGetError();
+		if (err == GL_NO_ERROR) {
+			return;
+		}
+		char message[64];
+		snprintf(message, sizeof(message), "glGetError() returned %04x, found %s", err, where);
+		if (glDebugLog.isRunning()) {
+			glDebugLog.push("high", "glGetError", "error", err, scope, message, -1);
+		}
+		else {
+			printf("GL error in \"%s\": %s\n", scope, message);
+		}
+	}
+}
+
+bool dyeTiled() {
+	return dyeTilesX * dyeTilesY > 1;
+}
+
+// split the color field into as few tiles as fit into the largest texture, of the same size, with a halo of a cell.
+// the halo is all that the bilinear filtering of the advection and of the display reads of the neighbours of a tile,
+// since the shaders sample every position in the tile that it is in.
+void initDyeTiles() {
+	GLint maxSize;
+	GL_C(glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize));
+	int limit = dyeTileLimit > 0 ? std::min(dyeTileLimit, (int)maxSize) : (int)maxSize;
+	if (dyeWidth <= limit && dyeHeight <= limit) {
+		dyeTilesX = dyeTilesY = 1;
+		dyeHalo = 0;
+	}
+	else {
+		dyeHalo = 1;
+		dyeTilesX = (dyeWidth + limit - 2 * dyeHalo - 1) / (limit - 2 * dyeHalo);
+		dyeTilesY = (dyeHeight + limit - 2 * dyeHalo - 1) / (limit - 2 * dyeHalo);
+	}
+	dyeTileWidth = (dyeWidth + dyeTilesX - 1) / dyeTilesX;
+	dyeTileHeight = (dyeHeight + dyeTilesY - 1) / dyeTilesY;
+	dyeTextureWidth = dyeTileWidth + 2 * dyeHalo;
+	dyeTextureHeight = dyeTileHeight + 2 * dyeHalo;
+	if (dyeTiled() && (hasGlVersion(4, 3) || glfwExtensionSupported("GL_ARB_copy_image"))) {
+		pglCopyImageSubData = (PFNGLCOPYIMAGESUBDATAPROC)glfwGetProcAddress("glCopyImageSubData");
+	}
+	if (dyeTiled()) {
+		printf("The %dx%d color field is split into %dx%d tiles of %dx%d cells\n", dyeWidth, dyeHeight, dyeTilesX, dyeTilesY,
+			dyeTileWidth, dyeTileHeight);
+	}
+}
+
 void initGlfw() {
 	if (!glfwInit())
 		exit(EXIT_FAILURE);
@@ -197,8 +749,14 @@ void initGlfw() {
 	glfwWindowHint(GLFW_SAMPLES, 0);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	if (glDebug) {
+		glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+	}
+	if (headless) {
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	}
 
-	window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Flashy Fluid Simulation Demo", NULL, NULL);
+	window = glfwCreateWindow(windowWidth, windowHeight, "Flashy Fluid Simulation Demo", NULL, NULL);
 	if (!window) {
 		glfwTerminate();
 		exit(EXIT_FAILURE);
@@ -209,107 +767,590 @@ void initGlfw() {
 
 	// load GLAD.
 	gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+	initGlDebug();
+
+	// allow the driver to use as many threads as it likes for compiling our shaders.
+	PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads = nullptr;
+	if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+		maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+	}
+	else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile")) {
+		maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+	}
+	if (maxShaderCompilerThreads != nullptr) {
+		maxShaderCompilerThreads(0xFFFFFFFF);
+		parallelShaderCompile = true;
+	}
+
+	initProgramBinaryCache();
+	initTextureStorage();
+	initComputeBackend();
 
 	// Bind and create VAO, otherwise, we can't do anything in OpenGL.
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
 
 	glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+
+	gridWidth = requestedGridWidth > 0 ? requestedGridWidth : fbWidth;
+	gridHeight = requestedGridHeight > 0 ? requestedGridHeight : fbHeight;
+	dyeWidth = requestedDyeWidth > 0 ? requestedDyeWidth : gridWidth;
+	dyeHeight = requestedDyeHeight > 0 ? requestedDyeHeight : gridHeight;
+	baseGridWidth = gridWidth;
+	baseGridHeight = gridHeight;
+	initDyeTiles();
+	layeredFields = ensembleSize > 1 || dyeTiled();
+}
+
+// a cache of the GL state that the passes change: the bound framebuffer, the program,
+// the texture units, the viewport, the clear color and the uniforms. the passes set their state through the functions below,
+// which skip the calls that would not change anything. so a pass simply sets everything it needs, and only pays for what changed.
+// nothing else may change this state behind the back of the cache. after deleting textures or programs, call invalidateGlState(),
+// since GL unbinds deleted objects, and their names get reused.
+const int CACHED_TEXTURE_UNITS = 4;
+const GLuint UNKNOWN_GL_OBJECT = 0xFFFFFFFF;
+
+struct CachedUniform {
+	uint32_t value[4];
+};
+
+struct GlStateCache {
+	GLuint framebuffer;
+	int framebufferLayers; // the layers of the render targets of framebuffer, see renderFullscreen().
+	GLuint program;
+	int activeUnit;
+	GLuint textures[CACHED_TEXTURE_UNITS];
+	int viewportWidth;
+	int viewportHeight;
+	float clearColor[4];
+	// keyed by program and location, since the uniforms are part of the program.
+	std::unordered_map<uint64_t, CachedUniform> uniforms;
+};
+
+GlStateCache glState;
+
+void invalidateGlState() {
+	glState.framebuffer = UNKNOWN_GL_OBJECT;
+	glState.program = UNKNOWN_GL_OBJECT;
+	glState.activeUnit = -1;
+	for (int i = 0; i < CACHED_TEXTURE_UNITS; ++i) {
+		glState.textures[i] = UNKNOWN_GL_OBJECT;
+	}
+	glState.viewportWidth = -1;
+	glState.viewportHeight = -1;
+	for (int i = 0; i < 4; ++i) {
+		glState.clearColor[i] = -1.0f;
+	}
+	glState.uniforms.clear();
+}
+
+void bindFramebuffer(GLuint framebuffer, int layers = 1) {
+	glState.framebufferLayers = layers;
+	if (glState.framebuffer == framebuffer) {
+		glCallsSkipped++;
+		return;
+	}
+	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
+	glState.framebuffer = framebuffer;
+}
+
+// bind a framebuffer to read from and another one to draw to, for glBlitFramebuffer().
+// the cache only knows framebuffers that are bound for both, so the next bindFramebuffer() always binds.
+void bindBlitFramebuffers(GLuint read, GLuint draw) {
+	GL_C(glBindFramebuffer(GL_READ_FRAMEBUFFER, read));
+	GL_C(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw));
+	glState.framebuffer = UNKNOWN_GL_OBJECT;
+}
+
+// a framebuffer for every combination of textures that is rendered to, created the first time, and then kept.
+// attaching the textures to a shared framebuffer makes the driver check its completeness again for every pass,
+// while binding a framebuffer that is known to be complete is cheap.
+// with layeredFields the textures are texture arrays, see createFloatTexture(), and they are attached with all their layers.
+// the framebuffers of a texture must be deleted along with it, so delete the textures with deleteTexture().
+const int MAX_RENDER_TARGETS = 4;
+typedef std::array<GLuint, MAX_RENDER_TARGETS> RenderTargets; // the unused ones are 0.
+std::map<RenderTargets, GLuint> targetFramebuffers;
+
+GLuint targetFramebuffer(const RenderTargets& targets) {
+	auto it = targetFramebuffers.find(targets);
+	if (it != targetFramebuffers.end()) {
+		return it->second;
+	}
+
+	GLuint framebuffer;
+	GL_C(glGenFramebuffers(1, &framebuffer));
+	bindFramebuffer(framebuffer);
+	GLenum drawBuffers[MAX_RENDER_TARGETS];
+	int n = 0;
+	while (n < MAX_RENDER_TARGETS && targets[n] != 0) {
+		GL_C(glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + n, targets[n], 0));
+		drawBuffers[n] = GL_COLOR_ATTACHMENT0 + n;
+		n++;
+	}
+	GL_C(glDrawBuffers(n, drawBuffers));
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		printf("A framebuffer with %d render targets is incomplete, status 0x%x\n", n, status);
+		exit(1);
+	}
+
+	targetFramebuffers[targets] = framebuffer;
+	return framebuffer;
+}
+
+int textureLayers(GLuint tex);
+
+// bind the framebuffer that renders to targets, which are the color attachments in that order.
+void bindRenderTargets(const RenderTargets& targets) {
+	bindFramebuffer(targetFramebuffer(targets), textureLayers(targets[0]));
+}
+
+// bind the framebuffer with tex as its only color attachment.
+void attachTexture(GLuint tex) {
+	RenderTargets targets = { { tex, 0, 0, 0 } };
+	bindRenderTargets(targets);
+}
+
+// the number of layers of every texture, see createFloatTexture().
+std::unordered_map<GLuint, int> textureLayerCounts;
+
+int textureLayers(GLuint tex) {
+	return textureLayerCounts[tex];
+}
+
+// whether tex is a texture of the color field, and that is split into tiles. only those have more than a layer per member.
+bool isTiledDye(GLuint tex) {
+	return dyeTiled() && textureLayers(tex) == ensembleSize * dyeTilesX * dyeTilesY;
+}
+
+// delete the texture, and the framebuffers that render to it. call invalidateGlState() afterwards.
+void deleteTexture(GLuint* tex) {
+	if (*tex == 0) {
+		return;
+	}
+	for (auto it = targetFramebuffers.begin(); it != targetFramebuffers.end();) {
+		if (std::find(it->first.begin(), it->first.end(), *tex) != it->first.end()) {
+			GL_C(glDeleteFramebuffers(1, &it->second));
+			it = targetFramebuffers.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+	GL_C(glDeleteTextures(1, tex));
+	textureLayerCounts.erase(*tex);
+	*tex = 0;
+}
+
+void useProgram(GLuint program) {
+	if (glState.program == program) {
+		glCallsSkipped++;
+		return;
+	}
+	GL_C(glUseProgram(program));
+	glState.program = program;
+}
+
+// bind tex for calls that work on the bound texture of the active unit, like glTexImage2D().
+void selectTexture(GLuint tex) {
+	if (glState.activeUnit != 0) {
+		GL_C(glActiveTexture(GL_TEXTURE0));
+		glState.activeUnit = 0;
+	}
+	if (glState.textures[0] == tex) {
+		glCallsSkipped++;
+		return;
+	}
+	GL_C(glBindTexture(textureTarget(), tex));
+	glState.textures[0] = tex;
+}
+
+void bindTexture(int unit, GLuint tex) {
+	if (glState.textures[unit] == tex) {
+		glCallsSkipped++;
+		return;
+	}
+	if (glState.activeUnit != unit) {
+		GL_C(glActiveTexture(GL_TEXTURE0 + unit));
+		glState.activeUnit = unit;
+	}
+	GL_C(glBindTexture(textureTarget(), tex));
+	glState.textures[unit] = tex;
+}
+
+void setViewport(int width, int height) {
+	if (glState.viewportWidth == width && glState.viewportHeight == height) {
+		glCallsSkipped++;
+		return;
+	}
+	GL_C(glViewport(0, 0, width, height));
+	glState.viewportWidth = width;
+	glState.viewportHeight = height;
+}
+
+void setClearColor(float r, float g, float b, float a) {
+	float* c = glState.clearColor;
+	if (c[0] == r && c[1] == g && c[2] == b && c[3] == a) {
+		glCallsSkipped++;
+		return;
+	}
+	GL_C(glClearColor(r, g, b, a));
+	c[0] = r;
+	c[1] = g;
+	c[2] = b;
+	c[3] = a;
+}
+
+// whether the uniform at location of the current program already has the value. if not, the value is remembered.
+bool uniformIsSet(GLint location, uint32_t x, uint32_t y, uint32_t z, uint32_t w) {
+	if (location == -1) {
+		glCallsSkipped++;
+		return true;
+	}
+	uint64_t key = ((uint64_t)glState.program << 32) | (uint32_t)location;
+	auto it = glState.uniforms.find(key);
+	if (it != glState.uniforms.end()) {
+		uint32_t* v = it->second.value;
+		if (v[0] == x && v[1] == y && v[2] == z && v[3] == w) {
+			glCallsSkipped++;
+			return true;
+		}
+	}
+	glState.uniforms[key] = CachedUniform{ { x, y, z, w } };
+	return false;
+}
+
+uint32_t floatBits(float f) {
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+void setUniform1i(GLint location, int x) {
+	if (!uniformIsSet(location, x, 0, 0, 0)) {
+		GL_C(glUniform1i(location, x));
+	}
+}
+
+void setUniform2i(GLint location, int x, int y) {
+	if (!uniformIsSet(location, x, y, 0, 0)) {
+		GL_C(glUniform2i(location, x, y));
+	}
+}
+
+void setUniform1f(GLint location, float x) {
+	if (!uniformIsSet(location, floatBits(x), 0, 0, 0)) {
+		GL_C(glUniform1f(location, x));
+	}
+}
+
+void setUniform2f(GLint location, float x, float y) {
+	if (!uniformIsSet(location, floatBits(x), floatBits(y), 0, 0)) {
+		GL_C(glUniform2f(location, x, y));
+	}
+}
+
+void setUniform4f(GLint location, float x, float y, float z, float w) {
+	if (!uniformIsSet(location, floatBits(x), floatBits(y), floatBits(z), floatBits(w))) {
+		GL_C(glUniform4f(location, x, y, z, w));
+	}
+}
+
+// the parameters that are the same for every pass of a frame, in the std140 layout of the Frame block in shaders/frame.glsl.
+// they are written once per frame, instead of setting uniforms on every program that uses them.
+// new parameters go at the end, in both places.
+struct FrameUniforms {
+	float delta[2];
+	float jacobiAlpha[2];
+	float jacobiBeta[2];
+	float dt;
+	float counter;
+	float stepFraction;
+	float blend;
+	int32_t sim;
+	float memberForce;
+	int32_t dyeSize[2];
+	int32_t dyeTiles[2];
+	int32_t dyeTileSize[2];
+	int32_t dyeHalo;
+	int32_t padding;
+};
+static_assert(sizeof(FrameUniforms) == 80, "FrameUniforms must match the std140 layout of the Frame block");
+
+// the uniform buffer is a ring of FRAME_UNIFORM_SLOTS slots, so the CPU can write the parameters of a frame
+// while the GPU still renders the ones before. a fence tells when the GPU is done with a slot, and it almost always is,
+// by the time the ring comes around to it again.
+// with ARB_buffer_storage(core in 4.4), the buffer is mapped once and stays mapped. otherwise, every slot is mapped
+// unsynchronized when it is written, which is safe because of the fences.
+const int FRAME_UNIFORM_SLOTS = 3;
+const GLuint FRAME_UNIFORM_BINDING = 0;
+
+PFNGLBUFFERSTORAGEPROC pglBufferStorage = nullptr;
+GLuint frameUniformBuffer = 0;
+GLintptr frameUniformStride = 0;
+char* frameUniformMapping = nullptr;
+GLsync frameUniformFences[FRAME_UNIFORM_SLOTS] = {};
+int frameUniformSlot = -1;
+
+void createFrameUniformBuffer() {
+	if (hasGlVersion(4, 4) || glfwExtensionSupported("GL_ARB_buffer_storage")) {
+		pglBufferStorage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+	}
+
+	GLint alignment = 256;
+	GL_C(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment));
+	frameUniformStride = ((GLintptr)sizeof(FrameUniforms) + alignment - 1) / alignment * alignment;
+	GLsizeiptr size = frameUniformStride * FRAME_UNIFORM_SLOTS;
+
+	GL_C(glGenBuffers(1, &frameUniformBuffer));
+	GL_C(glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer));
+	if (pglBufferStorage != nullptr) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GL_C(pglBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags));
+		GL_C(frameUniformMapping = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+	}
+	else {
+		GL_C(glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW));
+	}
+}
+
+// every program that uses the Frame block reads it from FRAME_UNIFORM_BINDING.
+void bindFrameUniformBlock(GLuint program) {
+	GLuint index = glGetUniformBlockIndex(program, "Frame");
+	if (index != GL_INVALID_INDEX) {
+		GL_C(glUniformBlockBinding(program, index, FRAME_UNIFORM_BINDING));
+	}
+}
+
+void updateFrameUniforms(const FrameUniforms& u) {
+	// everything since the last update used the previous slot.
+	if (frameUniformSlot >= 0) {
+		GL_C(frameUniformFences[frameUniformSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+	}
+	frameUniformSlot = (frameUniformSlot + 1) % FRAME_UNIFORM_SLOTS;
+
+	GLsync& fence = frameUniformFences[frameUniformSlot];
+	if (fence != 0) {
+		GL_C(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull));
+		GL_C(glDeleteSync(fence));
+		fence = 0;
+	}
+
+	GLintptr offset = frameUniformSlot * frameUniformStride;
+	if (frameUniformMapping != nullptr) {
+		memcpy(frameUniformMapping + offset, &u, sizeof(u));
+	}
+	else {
+		GL_C(glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer));
+		void* p;
+		GL_C(p = glMapBufferRange(GL_UNIFORM_BUFFER, offset, sizeof(u),
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+		memcpy(p, &u, sizeof(u));
+		GL_C(glUnmapBuffer(GL_UNIFORM_BUFFER));
+	}
+	GL_C(glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, frameUniformBuffer, offset, sizeof(u)));
+}
+
+// GL calls of the last call to renderFrame().
+long long lastFrameGlCalls = 0;
+long long lastFrameGlCallsSkipped = 0;
+
+void printGlCallCounts() {
+	printf("GL calls in the last frame: %lld, and %lld redundant calls were skipped\n", lastFrameGlCalls, lastFrameGlCallsSkipped);
 }
 
-// render fullscren quad.
+// --sparse-tiles splits the grid into tiles, and the passes of the simulation step that only look at the cells around them
+// only run on the tiles where something happens, see updateActiveTiles(). the masks have a texel per tile, and the vertex
+// shader of the passes and the compute kernels read them from TILE_UNIT.
+const int ACTIVE_TILE_SIZE = 32;
+const int TILE_UNIT = 3;
+bool sparseTiles = false;
+float sparseThreshold = 1e-4f;
+int tilesX, tilesY;
+GLuint tileActivityTex; // 1 where the velocity or the color is above sparseThreshold.
+GLuint activeTilesTex;  // tileActivityTex, grown by the distance that the fields can spread in a step.
+GLuint allTilesTex;     // a single active tile, which covers everything.
+// the masks have a layer per member of the ensemble, since every member has its own active tiles.
+// set by simulationStep() while a pass runs that only covers the active tiles.
+bool activeTilesOnly = false;
+
+// render fullscren quad. or the active tiles, in a pass that only covers those. every tile is an instance of the quad,
+// and the vertex shader collapses the inactive ones to a point, so they cost six vertices and no fragments.
+// the quad is drawn for every layer of the render targets, that is, for every member of the ensemble when they are fields.
 void renderFullscreen() {
-	GL_C(glDrawArrays(GL_TRIANGLES, 0, 6));
+	if (activeTilesOnly) {
+		bindTexture(TILE_UNIT, activeTilesTex);
+		GL_C(glDrawArraysInstanced(GL_TRIANGLES, 0, 6, tilesX * tilesY * glState.framebufferLayers));
+		return;
+	}
+	bindTexture(TILE_UNIT, allTilesTex);
+	GL_C(glDrawArraysInstanced(GL_TRIANGLES, 0, 6, glState.framebufferLayers));
 }
 
+// the passes below render a fullscreen quad, so they overwrite their target completely, and do not clear it first.
+// the few textures that are read before they are written are cleared by the render graph, and the old contents
+// of the others are discarded, see compileStepGraph().
 void clearTexture(GLuint tex) {
-	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-	GL_C(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0));
-	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+	attachTexture(tex);
+	setClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	GL_C(glClear(GL_COLOR_BUFFER_BIT));
+}
 
-	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-	{
-		GL_C(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
-		GL_C(glClear(GL_COLOR_BUFFER_BIT));
+// tells the driver that the contents of tex are not needed anymore, because it is about to be overwritten.
+// the passes do not write the halos of a tiled color field on its edges, which must keep the zeros they were cleared to.
+void invalidateTexture(GLuint tex) {
+	if (pglInvalidateTexImage != nullptr && !isTiledDye(tex)) {
+		GL_C(pglInvalidateTexImage(tex, 0));
 	}
-	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+GLint textureInternalFormat(GLuint tex);
+
+// the ways that the output of a kernel is used afterwards: by the texture fetches of the kernels and fragment passes
+// after it, by clears and draws into it, and by the readbacks of the dumps.
+const GLbitfield KERNEL_OUTPUT_BARRIERS = GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+	GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT;
+
+// run the kernel, which must be the current program, over every texel of dst. dst is bound to image unit 0.
+// the kernels cover the viewport, just like the fragment passes, so the passes set it the same way for both backends.
+// in a pass that only covers the active tiles, the groups of the inactive tiles return right away.
+// every layer of dst, that is every member of the ensemble, is a slice of groups along z.
+void dispatchKernel(const ComputeKernel& kernel, GLuint dst) {
+	bindTexture(TILE_UNIT, activeTilesOnly ? activeTilesTex : allTilesTex);
+	GL_C(pglBindImageTexture(0, dst, 0, layeredFields ? GL_TRUE : GL_FALSE, 0, GL_WRITE_ONLY, textureInternalFormat(dst)));
+	GLuint groupsX = (glState.viewportWidth + kernel.groupWidth - 1) / kernel.groupWidth;
+	GLuint groupsY = (glState.viewportHeight + kernel.groupHeight - 1) / kernel.groupHeight;
+	GL_C(pglDispatchCompute(groupsX, groupsY, textureLayers(dst)));
+	GL_C(pglMemoryBarrier(KERNEL_OUTPUT_BARRIERS));
 }
 
 // compute divergence of src, put the result in dst. 
 void computeDivergence(GLuint src, GLuint dst) {
-	{
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-		GL_C(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dst, 0));
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+	if (backend == BACKEND_COMPUTE) {
+		useProgram(divergenceKernel.program);
+		bindTexture(0, src);
+		dispatchKernel(divergenceKernel, dst);
+		return;
+	}
 
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-		{
-			GL_C(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
-			GL_C(glClear(GL_COLOR_BUFFER_BIT));
+	attachTexture(dst);
 
-			GL_C(glUseProgram(divergenceShader));
+	useProgram(divergenceShader);
 
-			GL_C(glUniform1i(dswTexLocation, 0));
-			GL_C(glActiveTexture(GL_TEXTURE0 + 0));
-			GL_C(glBindTexture(GL_TEXTURE_2D, src));
+	setUniform1i(dswTexLocation, 0);
+	bindTexture(0, src);
 
-			renderFullscreen();
-		}
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-	}
+	renderFullscreen();
 }
 
-// advect src, using u as velocity, and put the result into dst.
+// advect src, using u as velocity, over the time step of a substep, and put the result into dst.
+// the tiles of a tiled color field are advected like the layers of the members.
 void advect(GLuint src, GLuint u, GLuint dst) {
-	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-	GL_C(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dst, 0));
-	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+	if (backend == BACKEND_COMPUTE) {
+		useProgram(advectKernel.program);
+		setUniform1i(advectKernel.tiledDyeLocation, isTiledDye(dst));
+		bindTexture(0, u);
+		bindTexture(1, src);
+		dispatchKernel(advectKernel, dst);
+		return;
+	}
 
-	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-	{
-		GL_C(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
-		GL_C(glClear(GL_COLOR_BUFFER_BIT));
+	attachTexture(dst);
 
-		GL_C(glUseProgram(advectShader));
+	useProgram(advectShader);
 
-		GL_C(glUniform1i(asuTexLocation, 0));
-		GL_C(glActiveTexture(GL_TEXTURE0 + 0));
-		GL_C(glBindTexture(GL_TEXTURE_2D, u));
+	setUniform1i(asTiledDyeLocation, isTiledDye(dst));
+	setUniform1i(asuTexLocation, 0);
+	bindTexture(0, u);
 
-		GL_C(glUniform1i(assTexLocation, 1));
-		GL_C(glActiveTexture(GL_TEXTURE0 + 1));
-		GL_C(glBindTexture(GL_TEXTURE_2D, src));
+	setUniform1i(assTexLocation, 1);
+	bindTexture(1, src);
 
-		renderFullscreen();
-	}
-	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+	renderFullscreen();
 }
 
-// write the texture src to dst.
+// write the texture src to dst. this is only used for the color field, so it renders at the size of that.
 void writeTex(GLuint src, GLuint dst) {
-	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-	GL_C(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-		dst,
-		0));
-	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+	setViewport(dyeTextureWidth, dyeTextureHeight);
+	attachTexture(dst);
 
-	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-	{
-		GL_C(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
-		GL_C(glClear(GL_COLOR_BUFFER_BIT));
+	useProgram(writeTexShader);
 
-		GL_C(glUseProgram(writeTexShader));
+	setUniform1i(wtTiledDyeLocation, isTiledDye(dst));
+	setUniform1i(wtcTexLocation, 0);
+	bindTexture(0, src);
 
-		GL_C(glUniform1i(wtcTexLocation, 0));
-		GL_C(glActiveTexture(GL_TEXTURE0 + 0));
-		GL_C(glBindTexture(GL_TEXTURE_2D, src));
+	setUniform2f(wtOffsetLocation, -1.0f, -1.0f);
+	setUniform2f(wtSizeLocation, +2.0f, +2.0f);
 
-		GL_C(glUniform2f(wtOffsetLocation, -1.0f, -1.0f));
-		GL_C(glUniform2f(wtSizeLocation, +2.0f, +2.0f));
+	renderFullscreen();
+}
 
-		renderFullscreen();
+// the halos are copied with glCopyImageSubData(), if the driver has it. it copies a box of cells,
+// so a single call covers the same part of the halos of a whole run of layers. without it, every part of every halo
+// is a blit, between layers that are attached to a read and a draw framebuffer of their own.
+GLuint haloFramebuffers[2]; // created when they are first needed.
+
+// copy the cells along the edges of every tile of the color field tex into the halos of its neighbours, see dyeTilesX.
+// for every direction, the tiles that have a neighbour in it are a run of consecutive layers in every row of tiles,
+// or in all the rows of a member for the directions straight up and down. so with glCopyImageSubData() this costs
+// at most 2 + 6 * dyeTilesY calls per member, instead of a blit per tile and neighbour.
+void exchangeDyeHalos(GLuint tex) {
+	if (pglCopyImageSubData == nullptr) {
+		if (haloFramebuffers[0] == 0) {
+			GL_C(glGenFramebuffers(2, haloFramebuffers));
+		}
+		bindBlitFramebuffers(haloFramebuffers[0], haloFramebuffers[1]);
+	}
+
+	int members = textureLayers(tex) / (dyeTilesX * dyeTilesY);
+	for (int member = 0; member < members; ++member) {
+		for (int dy = -1; dy <= 1; ++dy) {
+			for (int dx = -1; dx <= 1; ++dx) {
+				if (dx == 0 && dy == 0) {
+					continue;
+				}
+				// the part of the halo towards the neighbour, in the cells of the tile, and in those of the neighbour.
+				int x = dx < 0 ? -dyeHalo : dx == 0 ? 0 : dyeTileWidth;
+				int y = dy < 0 ? -dyeHalo : dy == 0 ? 0 : dyeTileHeight;
+				int w = dx == 0 ? dyeTileWidth : dyeHalo;
+				int h = dy == 0 ? dyeTileHeight : dyeHalo;
+				int srcX = x - dx * dyeTileWidth + dyeHalo;
+				int srcY = y - dy * dyeTileHeight + dyeHalo;
+				// the tiles that have a neighbour in this direction, and the runs of their layers.
+				int beginX = std::max(-dx, 0);
+				int endX = dyeTilesX - std::max(dx, 0);
+				int beginY = std::max(-dy, 0);
+				int endY = dyeTilesY - std::max(dy, 0);
+				bool wholeRows = dx == 0;
+				for (int tileY = beginY; tileY < (wholeRows ? beginY + 1 : endY); ++tileY) {
+					int first = (member * dyeTilesY + tileY) * dyeTilesX + beginX;
+					int count = wholeRows ? (endY - beginY) * dyeTilesX : endX - beginX;
+					int offset = dy * dyeTilesX + dx;
+					if (count <= 0) {
+						continue;
+					}
+					if (pglCopyImageSubData != nullptr) {
+						GL_C(pglCopyImageSubData(tex, GL_TEXTURE_2D_ARRAY, 0, srcX, srcY, first + offset,
+							tex, GL_TEXTURE_2D_ARRAY, 0, x + dyeHalo, y + dyeHalo, first, w, h, count));
+						continue;
+					}
+					for (int layer = first; layer < first + count; ++layer) {
+						GL_C(glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tex, 0, layer + offset));
+						GL_C(glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tex, 0, layer));
+						GL_C(glBlitFramebuffer(srcX, srcY, srcX + w, srcY + h, x + dyeHalo, y + dyeHalo, x + dyeHalo + w, y + dyeHalo + h,
+							GL_COLOR_BUFFER_BIT, GL_NEAREST));
+					}
+				}
+			}
+		}
+	}
+
+	// the framebuffers must not keep tex alive, or attached under a name that gets reused, after it is deleted.
+	if (pglCopyImageSubData == nullptr) {
+		GL_C(glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 0, 0, 0));
+		GL_C(glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 0, 0, 0));
 	}
-	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
 }
 
 // solve the poisson pressure equation, by simple jacobi iteration.
@@ -321,100 +1362,780 @@ GLuint  jacobi(const int nIter, GLuint bTex, GLuint* tempTex) {
 		int curJ = (iter + 0) % 2;
 		int nextJ = (iter + 1) % 2;
 
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-		GL_C(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tempTex[nextJ], 0));
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-		{
-			GL_C(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
-			GL_C(glClear(GL_COLOR_BUFFER_BIT));
+		// the target still has the iteration before the last one. with sparse tiles, the inactive tiles of it must stay zero.
+		if (!activeTilesOnly) {
+			invalidateTexture(tempTex[nextJ]);
+		}
 
-			GL_C(glUseProgram(jacobiShader));
+		if (backend == BACKEND_COMPUTE) {
+			useProgram(jacobiKernel.program);
+			bindTexture(0, tempTex[curJ]);
+			bindTexture(1, bTex);
+			dispatchKernel(jacobiKernel, tempTex[nextJ]);
+			continue;
+		}
 
-			GL_C(glUniform1i(jsxTexLocation, 0));
-			GL_C(glActiveTexture(GL_TEXTURE0 + 0));
-			GL_C(glBindTexture(GL_TEXTURE_2D, tempTex[curJ]));
+		attachTexture(tempTex[nextJ]);
 
-			GL_C(glUniform1i(jsbTexLocation, 1));
-			GL_C(glActiveTexture(GL_TEXTURE0 + 1));
-			GL_C(glBindTexture(GL_TEXTURE_2D, bTex));
+		useProgram(jacobiShader);
 
-			GL_C(glUniform2f(jsAlphaLocation, -1.0f, -1.0f));
-			GL_C(glUniform2f(jsBetaLocation, 1.0 / 4.0, 1.0 / 4.0));
+		setUniform1i(jsxTexLocation, 0);
+		bindTexture(0, tempTex[curJ]);
 
+		setUniform1i(jsbTexLocation, 1);
+		bindTexture(1, bTex);
 
-			renderFullscreen();
-		}
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+		renderFullscreen();
 	}
 	
 	// now we return the calculuated pressure:
 	return tempTex[(iter + 0) % 2];
 }
 
+// the dpush()/dpop() scopes are timed on the GPU, if profiling was enabled on the command line, or while a trace
+// is recorded. every scope writes a GL_TIMESTAMP query where it begins and where it ends. the queries of a frame are only
+// read PROFILED_FRAMES frames later, when the GPU is long done with them, so the profiling never stalls.
+// if they are not available even then, the frame is dropped from the statistics, see pass_profiler.h
+const int PROFILED_FRAMES = 4;
+
+struct ProfiledScope {
+	const char* name;
+	int parent;
+	int beginQuery;
+	int endQuery;
+};
+
+struct ProfiledFrame {
+	std::vector<ProfiledScope> scopes;
+	std::vector<GLuint> queries; // grows as needed, and is reused.
+	int nQueries;
+	bool pending;
+	bool traced; // whether the scopes go into the trace.
+};
+
+bool profiling = false;
+PFNGLQUERYCOUNTERPROC pglQueryCounter = nullptr;
+ProfiledFrame profiledFrames[PROFILED_FRAMES];
+int profiledFrameIndex = 0;
+int currentScope = -1;
+// whether the scopes of the current frame are timed. only changes between frames.
+bool timingFrame = false;
+PassProfiler passProfiler;
+
+// a trace of the CPU and GPU work can be recorded, see trace_recorder.h
+std::string tracePath = "trace.json";
+bool traceAtStartup = false;
+// GL_TIMESTAMP values plus this are on the clock of traceNow().
+int64_t gpuToTraceNs = 0;
+
+int profilerTimestamp() {
+	ProfiledFrame& f = profiledFrames[profiledFrameIndex % PROFILED_FRAMES];
+	if (f.nQueries == (int)f.queries.size()) {
+		GLuint query;
+		GL_C(glGenQueries(1, &query));
+		f.queries.push_back(query);
+	}
+	GL_C(pglQueryCounter(f.queries[f.nQueries], GL_TIMESTAMP));
+	return f.nQueries++;
+}
+
+// read back the oldest frame, if the GPU is done with it.
+void collectProfiledFrame(ProfiledFrame& f) {
+	if (!f.pending) {
+		return;
+	}
+	f.pending = false;
+
+	// the timestamps are written in order, so if the last one is available, all of them are.
+	GLint available = 0;
+	GL_C(glGetQueryObjectiv(f.queries[f.nQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available));
+	if (!available) {
+		return;
+	}
+
+	std::vector<GLuint64> ns(f.nQueries);
+	for (int i = 0; i < f.nQueries; ++i) {
+		GL_C(pglGetQueryObjectui64v(f.queries[i], GL_QUERY_RESULT, &ns[i]));
+	}
+
+	if (profiling) {
+		std::vector<ScopeTiming> timings;
+		for (const ProfiledScope& scope : f.scopes) {
+			timings.push_back(ScopeTiming{ scope.name, scope.parent, double(ns[scope.endQuery] - ns[scope.beginQuery]) / 1.0e6 });
+		}
+		passProfiler.addFrame(timings);
+	}
+	if (f.traced) {
+		for (const ProfiledScope& scope : f.scopes) {
+			traceGpuSpan(scope.name, (int64_t)ns[scope.beginQuery] + gpuToTraceNs, (int64_t)ns[scope.endQuery] + gpuToTraceNs);
+		}
+	}
+}
+
+void dpush(const char* str);
+void dpop();
+
+bool initProfiler() {
+	pglQueryCounter = (PFNGLQUERYCOUNTERPROC)glfwGetProcAddress("glQueryCounter");
+	pglGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)glfwGetProcAddress("glGetQueryObjectui64v");
+	return pglQueryCounter != nullptr && pglGetQueryObjectui64v != nullptr;
+}
+
+// all scopes of a frame are nested under a single "frame" scope.
+void beginProfiledFrame() {
+	ProfiledFrame& f = profiledFrames[profiledFrameIndex % PROFILED_FRAMES];
+	collectProfiledFrame(f);
+
+	timingFrame = pglQueryCounter != nullptr && (profiling || traceEnabled());
+	if (!timingFrame) {
+		return;
+	}
+	f.scopes.clear();
+	f.nQueries = 0;
+	f.traced = traceEnabled();
+	currentScope = -1;
+	dpush("frame");
+}
+
+void endProfiledFrame() {
+	if (!timingFrame) {
+		return;
+	}
+	dpop();
+	timingFrame = false;
+	profiledFrames[profiledFrameIndex % PROFILED_FRAMES].pending = true;
+	profiledFrameIndex++;
+}
+
+// wait until the GPU is done with all the frames that are still pending, and read them back, oldest first.
+void collectProfiledFrames() {
+	GL_C(glFinish());
+	for (int i = 0; i < PROFILED_FRAMES; ++i) {
+		collectProfiledFrame(profiledFrames[(profiledFrameIndex + i) % PROFILED_FRAMES]);
+	}
+}
+
+void startTrace() {
+	// GL_TIMESTAMP is the time on the GPU clock, in nanoseconds. reading it right next to the CPU clock
+	// gives the offset between the two clocks.
+	if (pglQueryCounter != nullptr) {
+		GLint64 gpuNow;
+		GL_C(glGetInteger64v(GL_TIMESTAMP, &gpuNow));
+		gpuToTraceNs = traceNow() - gpuNow;
+	}
+	traceStart();
+	printf("Recording a trace\n");
+}
+
+// the GPU spans of a frame are only read back a few frames later, so the last frames are collected before the trace is
+// written. otherwise they would be lost, or end up in the next trace.
+void stopTrace() {
+	collectProfiledFrames();
+	traceStop(tracePath);
+}
+
 // these two are pretty useful, when debugging in RenderDoc or Nsight for instance.
 void dpush(const char* str) {
 #ifdef DEBUG_GROUPS
 	glad_glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, str);
 #endif
+	if (checkScopeGlErrors) {
+		checkGlErrorsAt("before the scope", str);
+	}
+	glScopes.push_back(str);
+	glScope.store(str, std::memory_order_relaxed);
+
+	if (timingFrame) {
+		ProfiledFrame& f = profiledFrames[profiledFrameIndex % PROFILED_FRAMES];
+		f.scopes.push_back(ProfiledScope{ str, currentScope, profilerTimestamp(), -1 });
+		currentScope = (int)f.scopes.size() - 1;
+	}
 }
 void dpop() {
 #ifdef DEBUG_GROUPS
 	glad_glPopDebugGroup();
 #endif
+	if (checkScopeGlErrors) {
+		checkGlErrorsAt("at the end of the scope", glScopes.back());
+	}
+	glScopes.pop_back();
+	glScope.store(glScopes.back(), std::memory_order_relaxed);
+
+	if (timingFrame) {
+		ProfiledFrame& f = profiledFrames[profiledFrameIndex % PROFILED_FRAMES];
+		f.scopes[currentScope].endQuery = profilerTimestamp();
+		currentScope = f.scopes[currentScope].parent;
+	}
 }
 
+// read back a float texture of size width x height, with a buffer per layer. only the first nChannels channels are returned.
+std::vector<std::vector<float> > readFloatTexture(GLuint tex, int width, int height, int nChannels) {
+	const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
 
-void renderFrame() {
-	float blend = 1.0f;
+	size_t layerSize = (size_t)width * height * nChannels;
+	std::vector<float> data(layerSize * textureLayers(tex));
+	selectTexture(tex);
+	GL_C(glPixelStorei(GL_PACK_ALIGNMENT, 1));
+	GL_C(glGetTexImage(textureTarget(), 0, formats[nChannels - 1], GL_FLOAT, data.data()));
 
-	// setup some reasonable default GL state.
-	GL_C(glDisable(GL_DEPTH_TEST));
-	GL_C(glDepthMask(false));
-	GL_C(glDisable(GL_BLEND));
-	GL_C(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
-	GL_C(glEnable(GL_CULL_FACE));
-	GL_C(glFrontFace(GL_CCW));
-	GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-	GL_C(glUseProgram(0));
-	GL_C(glBindTexture(GL_TEXTURE_2D, 0));
-	GL_C(glDepthFunc(GL_LESS));
+	std::vector<std::vector<float> > layers;
+	for (size_t begin = 0; begin < data.size(); begin += layerSize) {
+		layers.push_back(std::vector<float>(data.begin() + begin, data.begin() + begin + layerSize));
+	}
+	return layers;
+}
 
-	GL_C(glViewport(0, 0, fbWidth, fbHeight));
-	
-	// enable vertex buffer used for full screen quad rendering. 
-	// this buffer is used for all rendering, from now on.
-	GL_C(glEnableVertexAttribArray((GLuint)0));
-	GL_C(glBindBuffer(GL_ARRAY_BUFFER, fullscreenVertexVbo));
-	GL_C(glVertexAttribPointer((GLuint)0, 2, GL_FLOAT, GL_FALSE, sizeof(FullscreenVertex), (void*)0));
+// read back the color field tex, with a buffer of dyeWidth x dyeHeight cells per member.
+// the cells of the tiles of a tiled color field are put together, without the halos.
+std::vector<std::vector<float> > readDye(GLuint tex) {
+	if (!isTiledDye(tex)) {
+		return readFloatTexture(tex, dyeWidth, dyeHeight, 3);
+	}
+	std::vector<std::vector<float> > tiles = readFloatTexture(tex, dyeTextureWidth, dyeTextureHeight, 3);
+	std::vector<std::vector<float> > members(ensembleSize, std::vector<float>((size_t)dyeWidth * dyeHeight * 3));
+	int tileCount = dyeTilesX * dyeTilesY;
+	for (size_t layer = 0; layer < tiles.size(); ++layer) {
+		int tile = (int)layer % tileCount;
+		int x0 = tile % dyeTilesX * dyeTileWidth;
+		int y0 = tile / dyeTilesX * dyeTileHeight;
+		// the tiles on the right and at the top can reach past the color field.
+		int w = std::min(dyeTileWidth, dyeWidth - x0);
+		int h = std::min(dyeTileHeight, dyeHeight - y0);
+		std::vector<float>& member = members[layer / tileCount];
+		for (int y = 0; y < h; ++y) {
+			const float* row = tiles[layer].data() + ((size_t)(y + dyeHalo) * dyeTextureWidth + dyeHalo) * 3;
+			std::copy(row, row + w * 3, member.begin() + ((size_t)(y0 + y) * dyeWidth + x0) * 3);
+		}
+		std::vector<float>().swap(tiles[layer]);
+	}
+	return members;
+}
 
-	dpush("color Advection");
-	advect(cBegTex, uBegTex, cTempTex);
-	dpop();
-	
-	dpush("velocity Advection");
-	advect(uBegTex, uBegTex, wTex);
-	dpop();
+// the fields of the dumps. the fields of member 0 of an ensemble have the plain names, so a single simulation
+// can be compared against it, and the other members add velocity.1, pressure.1, color.1 and so on.
+std::vector<std::string> dumpFieldNames() {
+	std::vector<std::string> names;
+	for (int m = 0; m < ensembleSize; ++m) {
+		std::string suffix = m == 0 ? "" : "." + std::to_string(m);
+		names.push_back("velocity" + suffix);
+		names.push_back("pressure" + suffix);
+		names.push_back("color" + suffix);
+	}
+	return names;
+}
+
+void openFieldDump() {
+	// velocity is RG32F, pressure is stored in the x-component of a RG32F texture,
+	// and the alpha of the RGBA32F color is never used. so only store the channels that carry data.
+	std::vector<std::string> names = dumpFieldNames();
+	for (size_t i = 0; i < names.size(); i += 3) {
+		fieldDump.addField(names[i + 0], gridWidth, gridHeight, 2);
+		fieldDump.addField(names[i + 1], gridWidth, gridHeight, 1);
+		fieldDump.addField(names[i + 2], dyeWidth, dyeHeight, 3);
+	}
+	if (!fieldDump.open(dumpPath, DUMP_TILE_SIZE)) {
+		exit(1);
+	}
+}
+
+// the end-of-frame fields, in the order of openFieldDump().
+std::vector<std::vector<float> > readFields() {
+	std::vector<std::vector<float> > velocity = readFloatTexture(uTex, gridWidth, gridHeight, 2);
+	std::vector<std::vector<float> > pressure = readFloatTexture(pTex, gridWidth, gridHeight, 1);
+	std::vector<std::vector<float> > color = readDye(cTex);
+	std::vector<std::vector<float> > data;
+	for (int m = 0; m < ensembleSize; ++m) {
+		data.push_back(std::move(velocity[m]));
+		data.push_back(std::move(pressure[m]));
+		data.push_back(std::move(color[m]));
+	}
+	return data;
+}
+
+// hand the end-of-frame fields to the dump writer, which compresses and writes them in the background.
+void dumpFields() {
+	std::vector<std::vector<float> > data = readFields();
+	fieldDump.pushFrame(frameCount, data);
+}
+
+// an ensemble that is compared against a dump of a single simulation only compares member 0, see --ensemble.
+void compareFields() {
+	std::vector<std::string> names = dumpFieldNames();
+	std::vector<std::vector<float> > data = readFields();
+	if (ensembleSize > 1 && !golden.hasField(names[3])) {
+		names.resize(3);
+		data.resize(3);
+	}
+	golden.compareFrame(frameCount, names, data);
+}
+
+// export the end-of-frame fields of a member of the ensemble into a single multi-channel EXR file.
+// all channels of an EXR file have the same size, so if the color field has a different size than the grid,
+// the velocity and pressure go into a second file, PREFIX00042_flow.exr.
+// in an ensemble, every member has its own files, PREFIX00042_m3.exr and PREFIX00042_m3_flow.exr.
+// the actual encoding happens on the background threads of the exporter.
+void exportExr(int member, std::vector<float>& velocity, std::vector<float>& pressure, std::vector<float>& color) {
+	std::vector<std::vector<float> > flowBuffers;
+	flowBuffers.push_back(std::move(velocity));
+	flowBuffers.push_back(std::move(pressure));
+
+	std::vector<ExrChannel> flowChannels;
+	flowChannels.push_back(ExrChannel{ "velocity.X", flowBuffers[0].data() + 0, 2 });
+	flowChannels.push_back(ExrChannel{ "velocity.Y", flowBuffers[0].data() + 1, 2 });
+	flowChannels.push_back(ExrChannel{ "pressure.Y", flowBuffers[1].data() + 0, 1 });
+
+	std::vector<std::vector<float> > colorBuffers;
+	colorBuffers.push_back(std::move(color));
+
+	// the color is stored in the default layer, so viewers will show it directly.
+	std::vector<ExrChannel> colorChannels;
+	colorChannels.push_back(ExrChannel{ "R", colorBuffers[0].data() + 0, 3 });
+	colorChannels.push_back(ExrChannel{ "G", colorBuffers[0].data() + 1, 3 });
+	colorChannels.push_back(ExrChannel{ "B", colorBuffers[0].data() + 2, 3 });
+
+	char frame[16];
+	snprintf(frame, sizeof(frame), "%05d", frameCount);
+	std::string name = exrPrefix + frame + (ensembleSize > 1 ? "_m" + std::to_string(member) : "");
+	if (dyeWidth == gridWidth && dyeHeight == gridHeight) {
+		for (std::vector<float>& b : colorBuffers) {
+			flowBuffers.push_back(std::move(b));
+		}
+		flowChannels.insert(flowChannels.end(), colorChannels.begin(), colorChannels.end());
+		exrExporter.push(name + ".exr", gridWidth, gridHeight, flowBuffers, flowChannels);
+	}
+	else {
+		exrExporter.push(name + ".exr", dyeWidth, dyeHeight, colorBuffers, colorChannels);
+		exrExporter.push(name + "_flow.exr", gridWidth, gridHeight, flowBuffers, flowChannels);
+	}
+}
+
+void exportExr() {
+	std::vector<std::vector<float> > velocity = readFloatTexture(uTex, gridWidth, gridHeight, 2);
+	std::vector<std::vector<float> > pressure = readFloatTexture(pTex, gridWidth, gridHeight, 1);
+	std::vector<std::vector<float> > color = readDye(cTex);
+	for (int m = 0; m < ensembleSize; ++m) {
+		exportExr(m, velocity[m], pressure[m], color[m]);
+	}
+}
+
+GLuint createFloatTexture(float* data, int width, int height, int layers, GLint internalFormat, GLint format, GLenum type);
+
+// physical diagnostics are computed every metricsEvery frames, and written to metricsPath, see diagnostics.h
+// the fields are reduced on the GPU, by repeatedly summing up blocks of 2x2 texels, and only the final 1x1 textures
+// are copied into a pixel buffer. the copy is fenced, and the buffer is only mapped once the fence has signaled,
+// usually a frame or two later. so the diagnostics never stall. if all the buffers are still in flight,
+// a diagnostics frame is skipped instead.
+std::string metricsPath = "";
+int metricsEvery = 10;
+const int DIAGNOSTICS_READBACKS = 3;
+
+struct DiagnosticsReadback {
+	GLuint pbo;
+	GLsync fence;
+	int frame;
+	float dt;
+	int gridWidth, gridHeight;
+	int dyeWidth, dyeHeight;
+};
+DiagnosticsReadback diagnosticsReadbacks[DIAGNOSTICS_READBACKS];
+int diagnosticsIssued = 0;
+int diagnosticsRead = 0;
+
+// what the first reduction pass sums up, see the reduce shader.
+enum ReduceMode {
+	REDUCE_VELOCITY = 0,
+	REDUCE_COLOR = 1,
+	REDUCE_PARTIAL_SUMS = 2,
+};
+
+// every level is half the size of the previous one, and the last one is 1x1. the first level sums up larger blocks
+// of a field that is too large for half of it to fit into a texture, like a tiled color field.
+struct ReductionChain {
+	std::vector<GLuint> levels;
+	int width = 0; // size of the field that is reduced.
+	int height = 0;
+	int firstBlock = 2; // the first level sums up blocks of firstBlock x firstBlock texels.
+};
+ReductionChain gridReduction;
+ReductionChain dyeReduction;
+
+// (re)create the levels if the size of the field changed.
+void createReductionChain(ReductionChain& chain, int width, int height) {
+	if (chain.width == width && chain.height == height) {
+		return;
+	}
+	for (GLuint& tex : chain.levels) {
+		deleteTexture(&tex);
+	}
+	invalidateGlState();
+	chain.levels.clear();
+	chain.width = width;
+	chain.height = height;
+
+	GLint maxSize;
+	GL_C(glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize));
+	chain.firstBlock = 2;
+	while ((width + chain.firstBlock - 1) / chain.firstBlock > maxSize || (height + chain.firstBlock - 1) / chain.firstBlock > maxSize) {
+		chain.firstBlock *= 2;
+	}
+
+	int w = width;
+	int h = height;
+	int block = chain.firstBlock;
+	do {
+		w = (w + block - 1) / block;
+		h = (h + block - 1) / block;
+		block = 2;
+		chain.levels.push_back(createFloatTexture(nullptr, w, h, 1, GL_RGBA32F, GL_RGBA, GL_FLOAT));
+	} while (w > 1 || h > 1);
+}
+
+// reduce a field to a single texel, and return the texture that holds it.
+GLuint reduceField(ReductionChain& chain, ReduceMode mode, GLuint aTex, GLuint bTex, GLuint cTex) {
+	useProgram(reduceShader);
+	setUniform1i(rdaTexLocation, 0);
+	setUniform1i(rdbTexLocation, 1);
+	setUniform1i(rdcTexLocation, 2);
+
+	bindTexture(1, bTex);
+	bindTexture(2, cTex);
+
+	int w = chain.width;
+	int h = chain.height;
+	for (size_t i = 0; i < chain.levels.size(); ++i) {
+		int block = i == 0 ? chain.firstBlock : 2;
+		attachTexture(chain.levels[i]);
+		setViewport((w + block - 1) / block, (h + block - 1) / block);
+
+		bindTexture(0, i == 0 ? aTex : chain.levels[i - 1]);
+		setUniform1i(rdModeLocation, i == 0 ? mode : REDUCE_PARTIAL_SUMS);
+		setUniform2i(rdSizeLocation, w, h);
+		setUniform1i(rdBlockLocation, block);
+
+		renderFullscreen();
+
+		w = (w + block - 1) / block;
+		h = (h + block - 1) / block;
+	}
+
+	return chain.levels.back();
+}
+
+// reduce the fields at the end of the frame, and start copying the results back.
+void issueDiagnostics() {
+	if (diagnosticsIssued - diagnosticsRead == DIAGNOSTICS_READBACKS) {
+		return;
+	}
+	DiagnosticsReadback& r = diagnosticsReadbacks[diagnosticsIssued % DIAGNOSTICS_READBACKS];
+
+	// wDivergenceTex still has the divergence from before the projection of the last substep.
+	// the divergence after it goes into the pressure texture that the jacobi iterations did not end in, which is free now.
+	GLuint divergenceAfter = pTex == pTempTex[0] ? pTempTex[1] : pTempTex[0];
+	setViewport(gridWidth, gridHeight);
+	computeDivergence(uTex, divergenceAfter);
+
+	createReductionChain(gridReduction, gridWidth, gridHeight);
+	createReductionChain(dyeReduction, dyeWidth, dyeHeight);
+	GLuint gridSums = reduceField(gridReduction, REDUCE_VELOCITY, uTex, wDivergenceTex, divergenceAfter);
+	GLuint dyeSums = reduceField(dyeReduction, REDUCE_COLOR, cTex, 0, 0);
+
+	if (r.pbo == 0) {
+		GL_C(glGenBuffers(1, &r.pbo));
+		GL_C(glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo));
+		GL_C(glBufferData(GL_PIXEL_PACK_BUFFER, 8 * sizeof(float), nullptr, GL_STREAM_READ));
+	}
+	GL_C(glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo));
+	attachTexture(gridSums);
+	GL_C(glReadPixels(0, 0, 1, 1, GL_RGBA, GL_FLOAT, (void*)0));
+	attachTexture(dyeSums);
+	GL_C(glReadPixels(0, 0, 1, 1, GL_RGBA, GL_FLOAT, (void*)(4 * sizeof(float))));
+	GL_C(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+	GL_C(r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+	r.frame = frameCount;
+	r.dt = (1.0f / 60.0f) / float(quality.substeps);
+	r.gridWidth = gridWidth;
+	r.gridHeight = gridHeight;
+	r.dyeWidth = dyeWidth;
+	r.dyeHeight = dyeHeight;
+	diagnosticsIssued++;
+}
+
+// write out the diagnostics whose copies have finished. never waits for the GPU.
+void collectDiagnostics() {
+	while (diagnosticsRead < diagnosticsIssued) {
+		DiagnosticsReadback& r = diagnosticsReadbacks[diagnosticsRead % DIAGNOSTICS_READBACKS];
+		GLenum status;
+		GL_C(status = glClientWaitSync(r.fence, 0, 0));
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+			return;
+		}
+		GL_C(glDeleteSync(r.fence));
+		r.fence = 0;
+
+		DiagnosticSums sums;
+		GL_C(glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo));
+		const float* p;
+		GL_C(p = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 8 * sizeof(float), GL_MAP_READ_BIT));
+		if (p != nullptr) {
+			sums.velocitySq = p[0];
+			sums.divergenceBeforeSq = p[1];
+			sums.divergenceAfterSq = p[2];
+			sums.maxVelocitySq = p[3];
+			for (int i = 0; i < 3; ++i) {
+				sums.dye[i] = p[4 + i];
+			}
+			GL_C(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+		}
+		GL_C(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+		diagnosticsRead++;
+
+		// a buffer that can not be mapped only loses its sample, and the metrics keep the one before it.
+		if (p == nullptr) {
+			printf("Could not map the diagnostics of frame %d, they are skipped\n", r.frame);
+			continue;
+		}
+		writeMetrics(metricsPath, computeDiagnostics(r.frame, sums, r.gridWidth, r.gridHeight, r.dyeWidth, r.dyeHeight, r.dt));
+	}
+}
+
+// how far the advection of a step can move the fields, in cells. the fastest flows of the simulations move about 11 cells a frame.
+const int ADVECTION_MARGIN = 16;
+
+// finds the active tiles, from the velocity after the forces were added, and from the color. the tiles are then grown
+// by the distance that the fields can spread until the next time they are found: the pressure spreads by a cell
+// in every jacobi iteration, the divergence and the gradient reach a cell further each, and the advection of the next step
+// moves the fields by up to ADVECTION_MARGIN cells. so the tiled passes give the same result as running everywhere,
+// if the fields are zero in the inactive tiles. they are only below sparseThreshold there, which is what is lost.
+void updateActiveTiles() {
+	setViewport(tilesX, tilesY);
+	attachTexture(tileActivityTex);
+
+	useProgram(tileActivityShader);
+
+	setUniform1i(tawTexLocation, 0);
+	bindTexture(0, wTempTex);
+
+	setUniform1i(tacTexLocation, 1);
+	bindTexture(1, cTex);
+
+	setUniform1f(taThresholdLocation, sparseThreshold);
+	setUniform2i(taTileCountLocation, tilesX, tilesY);
+
+	renderFullscreen();
+
+	float tileCells = std::min(float(gridWidth) / float(tilesX), float(gridHeight) / float(tilesY));
+	int margin = quality.jacobiIterations + 2 + ADVECTION_MARGIN;
+
+	attachTexture(activeTilesTex);
+
+	useProgram(tileDilationShader);
+
+	setUniform1i(tdaTexLocation, 0);
+	bindTexture(0, tileActivityTex);
+
+	setUniform1i(tdRadiusLocation, (int)ceil(float(margin) / tileCells));
+
+	renderFullscreen();
+}
+
+// changes to the fields that happen at the transitions between the simulations.
+// they are applied right after the advection, in the first substep of a frame.
+struct Transition {
+	bool clearVelocity;
+	bool clearColor;
+	GLuint image; // written into the color field, if not 0.
+};
+
+// a pass of the simulation step, with the fields that it reads and writes.
+// scopes is the path of dpush() scopes that the pass runs in, the last one is the pass itself.
+struct StepPass {
+	std::vector<const char*> scopes;
+	std::vector<GLuint*> reads;
+	std::vector<GLuint*> writes;
+	std::function<bool(const Transition&)> enabled; // the pass always runs, if this is empty.
+	std::function<void(const Transition&)> run;
+	// with --sparse-tiles, the pass only runs on the active tiles, and the rest of what it writes is cleared.
+	bool tiled;
+
+	// filled in by compileStepGraph().
+	std::vector<GLuint*> clears;
+	std::vector<GLuint*> invalidates;
+
+	StepPass(std::vector<const char*> scopes_, std::vector<GLuint*> reads_, std::vector<GLuint*> writes_,
+		std::function<bool(const Transition&)> enabled_, std::function<void(const Transition&)> run_, bool tiled_ = false)
+		: scopes(scopes_), reads(reads_), writes(writes_), enabled(enabled_), run(run_), tiled(tiled_) {
+	}
+};
+
+// the simulation step, as a fixed list of passes. every pass renders at the size of the field that it writes.
+// the velocity is sampled with texture coordinates, so it does not matter that it has another size.
+std::vector<StepPass> stepPasses = {
+	{ { "color Advection" }, { &cTex, &uTex }, { &cTempTex }, nullptr, [](const Transition&) {
+		setViewport(dyeTextureWidth, dyeTextureHeight);
+		advect(cTex, uTex, cTempTex);
+	}, true },
+	{ { "velocity Advection" }, { &uTex }, { &wTex }, nullptr, [](const Transition&) {
+		setViewport(gridWidth, gridHeight);
+		advect(uTex, uTex, wTex);
+	}, true },
+	{ { "Clear velocity" }, {}, { &wTex }, [](const Transition& t) { return t.clearVelocity; }, [](const Transition&) {
+		clearTexture(wTex);
+	} },
+	{ { "Write image" }, {}, { &cTempTex }, [](const Transition& t) { return t.image != 0; }, [](const Transition& t) {
+		writeTex(t.image, cTempTex);
+	} },
+	{ { "Clear color" }, {}, { &cTempTex }, [](const Transition& t) { return t.clearColor; }, [](const Transition&) {
+		clearTexture(cTempTex);
+	} },
+	{ { "c Add Force" }, { &wTex }, { &wTempTex }, nullptr, [](const Transition&) {
+		setViewport(gridWidth, gridHeight);
+		if (backend == BACKEND_COMPUTE) {
+			useProgram(forceKernel.program);
+			bindTexture(0, wTex);
+			dispatchKernel(forceKernel, wTempTex);
+			return;
+		}
+		attachTexture(wTempTex);
+
+		useProgram(forceShader);
+
+		setUniform1i(fswTexLocation, 0);
+		bindTexture(0, wTex);
+
+		renderFullscreen();
+	} },
+	{ { "Add Color" }, { &cTempTex }, { &cTex }, nullptr, [](const Transition&) {
+		setViewport(dyeTextureWidth, dyeTextureHeight);
+		if (backend == BACKEND_COMPUTE) {
+			useProgram(addColorKernel.program);
+			setUniform1i(addColorKernel.tiledDyeLocation, dyeTiled());
+			bindTexture(0, cTempTex);
+			dispatchKernel(addColorKernel, cTex);
+			return;
+		}
+		attachTexture(cTex);
+
+		useProgram(addColorShader);
+
+		setUniform1i(acTiledDyeLocation, dyeTiled());
+		setUniform1i(accTexLocation, 0);
+		bindTexture(0, cTempTex);
+
+		renderFullscreen();
+	} },
+	// the next advection and the display read the color across the edges of its tiles.
+	{ { "Dye halos" }, { &cTex }, { &cTex }, [](const Transition&) { return dyeTiled(); }, [](const Transition&) {
+		exchangeDyeHalos(cTex);
+	} },
+	// the emitters can add force and color anywhere, so they cover everything, and the tiles that the rest of this step,
+	// and the advection of the next one, run on are found after them.
+	{ { "Active tiles" }, { &wTempTex, &cTex }, {}, [](const Transition&) { return sparseTiles; }, [](const Transition&) {
+		updateActiveTiles();
+	} },
+	// subtraction of pressure gradient.
+	// this is necessary, in order to make the divergence of the fluid equal to zero,
+	// which is what makes it act like a fluid.
+	{ { "Pressure Gradient Subtract", "Compute divergence of w" }, { &wTempTex }, { &wDivergenceTex }, nullptr, [](const Transition&) {
+		setViewport(gridWidth, gridHeight);
+		computeDivergence(wTempTex, wDivergenceTex);
+	}, true },
+	// compute pressure, using jacobi iterations. the first iteration reads pTempTex[0] as the initial guess of zero,
+	// so the graph clears it.
+	{ { "Pressure Gradient Subtract", "Compute pressure", "Jacobi" }, { &pTempTex[0], &wDivergenceTex }, { &pTempTex[0], &pTempTex[1] }, nullptr, [](const Transition&) {
+		setViewport(gridWidth, gridHeight);
+		pTex = jacobi(quality.jacobiIterations,
+			wDivergenceTex, // b
+			pTempTex
+		);
+	}, true },
+	// now we have computed the pressure, now subtract the gradient of the pressure.
+	{ { "Pressure Gradient Subtract", "pressure gradient subtraction" }, { &wTempTex, &pTempTex[0], &pTempTex[1] }, { &uTex }, nullptr, [](const Transition&) {
+		setViewport(gridWidth, gridHeight);
+		if (backend == BACKEND_COMPUTE) {
+			useProgram(gradientSubtractionKernel.program);
+			bindTexture(0, wTempTex);
+			bindTexture(1, pTex);
+			dispatchKernel(gradientSubtractionKernel, uTex);
+			return;
+		}
+		attachTexture(uTex);
+
+		useProgram(gradientSubtractionShader);
+
+		setUniform1i(gsswTexLocation, 0);
+		bindTexture(0, wTempTex);
+
+		setUniform1i(gsspTexLocation, 1);
+		bindTexture(1, pTex);
+
+		renderFullscreen();
+	}, true },
+};
+
+// advance the simulation by a substep, whose length is in the Frame uniform block.
+// afterwards, uTex and cTex hold the new velocity and color.
+void simulationStep(const Transition& transition) {
+	// the scopes that the passes share are only opened once.
+	std::vector<const char*> open;
+	for (const StepPass& pass : stepPasses) {
+		if (pass.enabled && !pass.enabled(transition)) {
+			continue;
+		}
+
+		size_t groups = pass.scopes.size() - 1;
+		size_t common = 0;
+		while (common < open.size() && common < groups && strcmp(open[common], pass.scopes[common]) == 0) {
+			common++;
+		}
+		while (open.size() > common) {
+			dpop();
+			open.pop_back();
+		}
+		for (size_t i = common; i < groups; ++i) {
+			dpush(pass.scopes[i]);
+			open.push_back(pass.scopes[i]);
+		}
+
+		dpush(pass.scopes.back());
+		for (GLuint* tex : pass.invalidates) {
+			invalidateTexture(*tex);
+		}
+		for (GLuint* tex : pass.clears) {
+			clearTexture(*tex);
+		}
+		activeTilesOnly = sparseTiles && pass.tiled;
+		pass.run(transition);
+		activeTilesOnly = false;
+		dpop();
+	}
+	while (!open.empty()) {
+		dpop();
+		open.pop_back();
+	}
+}
+
+void renderFrame() {
+	float blend = 1.0f;
+	long long glCallsBefore = glCalls;
+	long long glCallsSkippedBefore = glCallsSkipped;
 
-	// we use this simple counter for progressing the state of the the simulation.
-	static int icounter = 0;
 	icounter++;
 	
+	Transition transition = { false, false, 0 };
+
 	// below is code that handles smooth transitions between the four simulations.
-	{
+	if (!stageLocked) {
 		if (icounter > 400 && icounter < 700 && curSim == CIRCLE_SIM) {
 			float t = 1.0f - ((float)icounter - 400.0f) / 300.0f;
 			blend = t;
 		}
 		else if (icounter == 700 && curSim == CIRCLE_SIM) {
 
-			clearTexture(wTex);
+			transition.clearVelocity = true;
 
 			// add color.
-			dpush("Write Mona Lisa");
-			writeTex(monaTex, cTempTex);
-			dpop();
+			transition.image = monaTex;
 
 			blend = 0.0f;
 			icounter = 0;
@@ -435,11 +2156,9 @@ void renderFrame() {
 			blend = t;
 		}
 		else if (icounter == 1200 && curSim == MONA_LISA_SIM) {
-			clearTexture(wTex);
+			transition.clearVelocity = true;
 
-			dpush("Write Scream");
-			writeTex(screamTex, cTempTex);
-			dpop();
+			transition.image = screamTex;
 
 			icounter = 0;
 			blend = 0.0f;
@@ -460,8 +2179,8 @@ void renderFrame() {
 		}
 
 		else if (icounter == 1300 && curSim == THE_SCREAM_SIM) {
-			clearTexture(wTex);
-			clearTexture(cTempTex);
+			transition.clearVelocity = true;
+			transition.clearColor = true;
 			blend = 0.0f;
 			icounter = 0;
 			curSim = RAINBOW_SIM;
@@ -486,795 +2205,1506 @@ void renderFrame() {
 		}
 	}
 	
-	// add force.
-	dpush("c Add Force");
-	{
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-		GL_C(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-			wTempTex,
-			//uEndTex,	
-			0));
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-		{
-			GL_C(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
-			GL_C(glClear(GL_COLOR_BUFFER_BIT));
-
-			GL_C(glUseProgram(forceShader));
-
-			GL_C(glUniform1i(fswTexLocation, 0));
-			GL_C(glActiveTexture(GL_TEXTURE0 + 0));
-			GL_C(glBindTexture(GL_TEXTURE_2D, wTex));
-
-			GL_C(glUniform1f(fsCounterLocation, float(icounter)));
-			GL_C(glUniform1i(fsSimLocation, curSim));
-			
-
-			renderFullscreen();
-		}
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+	// the transition is only applied once per frame, and the emitters add a fraction of their force and color
+	// in every substep. so the substeps only make the time integration more accurate.
+	FrameUniforms u = {};
+	u.delta[0] = 1.0f / float(gridWidth);
+	u.delta[1] = 1.0f / float(gridHeight);
+	u.jacobiAlpha[0] = u.jacobiAlpha[1] = -1.0f;
+	u.jacobiBeta[0] = u.jacobiBeta[1] = 1.0f / 4.0f;
+	u.stepFraction = 1.0f / float(quality.substeps);
+	// 1.0 / 60.0 is time step of a whole frame.
+	u.dt = (1.0f / 60.0f) * u.stepFraction;
+	u.counter = float(icounter);
+	u.blend = blend;
+	u.sim = curSim;
+	u.memberForce = ensembleForce;
+	u.dyeSize[0] = dyeWidth;
+	u.dyeSize[1] = dyeHeight;
+	u.dyeTiles[0] = dyeTilesX;
+	u.dyeTiles[1] = dyeTilesY;
+	u.dyeTileSize[0] = dyeTileWidth;
+	u.dyeTileSize[1] = dyeTileHeight;
+	u.dyeHalo = dyeHalo;
+	updateFrameUniforms(u);
+
+	const Transition noTransition = { false, false, 0 };
+	for (int step = 0; step < quality.substeps; ++step) {
+		simulationStep(step == 0 ? transition : noTransition);
 	}
-	dpop();
-
-	// add color.
-	dpush("Add Color");
-	{
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-		GL_C(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-			cEndTex,
-			//uEndTex,	
-			0));
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-		{
-			GL_C(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
-			GL_C(glClear(GL_COLOR_BUFFER_BIT));
-
-			GL_C(glUseProgram(addColorShader));
 
-			GL_C(glUniform1i(accTexLocation, 0));
-			GL_C(glActiveTexture(GL_TEXTURE0 + 0));
-			GL_C(glBindTexture(GL_TEXTURE_2D, cTempTex));
-
-			GL_C(glUniform1f(acCounterLocation, float(icounter)));
-			GL_C(glUniform1i(acSimLocation, curSim));
-			
-			renderFullscreen();
+	if (metricsPath != "") {
+		collectDiagnostics();
+		if (frameCount % metricsEvery == 0) {
+			dpush("Diagnostics");
+			issueDiagnostics();
+			dpop();
 		}
-		GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
 	}
-	dpop();
 
-	dpush("Pressure Gradient Subtract");
-	// subtraction of pressure gradient.
-	// this is necessary, in order to make the divergence of the fluid equal to zero, 
-	// which is what makes it act like a fluid.
-	{
-		dpush("Compute divergence of w");
-		computeDivergence(wTempTex, wDivergenceTex);
+	if (fieldDump.isOpen() && frameCount % dumpEvery == 0) {
+		dpush("Dump fields");
+		dumpFields();
 		dpop();
+	}
 
-		dpush("Compute pressure");
-		// compute pressure, using jacobi iterations.
-		{
-			dpush("Clear pTemp Textures");
-			clearTexture(pTempTex[0]);
-			clearTexture(pTempTex[1]);
-			dpop();
-
-			dpush("Jacobi");
-			pTex = jacobi(40,
-				wDivergenceTex, // b
-				pTempTex
-			);
-			dpop();
-
-		}
+	if (exrExporter.isRunning() && frameCount % exrEvery == 0) {
+		dpush("Export EXR");
+		exportExr();
 		dpop();
+	}
 
-		// now we have computed the pressure, now subtract the gradient of the pressure. 
-		dpush("pressure gradient subtraction");
-		{
-			GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-			GL_C(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, uEndTex, 0));
-			GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-
-			GL_C(glBindFramebuffer(GL_FRAMEBUFFER, fbo0));
-			{
-				GL_C(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
-				GL_C(glClear(GL_COLOR_BUFFER_BIT));
-
-				GL_C(glUseProgram(gradientSubtractionShader));
-
-				GL_C(glUniform1i(gsswTexLocation, 0));
-				GL_C(glActiveTexture(GL_TEXTURE0 + 0));
-				GL_C(glBindTexture(GL_TEXTURE_2D, wTempTex));
-
-				GL_C(glUniform1i(gsspTexLocation, 1));
-				GL_C(glActiveTexture(GL_TEXTURE0 + 1));
-				GL_C(glBindTexture(GL_TEXTURE_2D, pTex));
-
-				renderFullscreen();
-			}
-			GL_C(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-		}
+	if (golden.isOpen() && golden.hasFrame(frameCount)) {
+		dpush("Compare fields");
+		compareFields();
 		dpop();
-
 	}
-	dpop();
 
 	dpush("Rendering");
 	{
-		GL_C(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
-		GL_C(glClear(GL_COLOR_BUFFER_BIT));
+		bindFramebuffer(0);
+		setViewport(fbWidth, fbHeight);
+		// the last frame is overwritten completely. without invalidation, clearing is the next best way to tell
+		// a tiled GPU that it does not have to load it.
+		if (pglInvalidateFramebuffer != nullptr) {
+			const GLenum attachments[] = { GL_COLOR, GL_DEPTH, GL_STENCIL };
+			GL_C(pglInvalidateFramebuffer(GL_FRAMEBUFFER, 3, attachments));
+		}
+		else {
+			setClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+			GL_C(glClear(GL_COLOR_BUFFER_BIT));
+		}
 
-		GL_C(glUseProgram(visShader));
+		useProgram(visShader);
 
-		GL_C(glUniform1i(vsTexLocation, 0));
-		GL_C(glActiveTexture(GL_TEXTURE0 + 0));
-		GL_C(glBindTexture(GL_TEXTURE_2D, cEndTex));
-		
-		GL_C(glUniform1f(vsBlendLocation, blend));
+		setUniform1i(vsTexLocation, 0);
+		bindTexture(0, cTex);
+		setUniform1i(vsBicubicLocation, dyeWidth != fbWidth || dyeHeight != fbHeight);
 		
 		renderFullscreen();
 	}
 	dpop();
 
-	// uBegTex is velocity at beginning of frame, and uEndTex is velocity at end of frame.
-	// we ping pong between these two textures below.(and do same for color)
-	{
+	frameCount++;
+	lastFrameGlCalls = glCalls - glCallsBefore;
+	lastFrameGlCallsSkipped = glCallsSkipped - glCallsSkippedBefore;
+}
 
-		// swap.
-		GLuint temp = uBegTex;
-		uBegTex = uEndTex;
-		uEndTex = temp;
+void resizeGrid(int w, int h);
 
-		temp = cBegTex;
-		cBegTex = cEndTex;
-		cEndTex = temp;
-	}
+// true only in the frame where the key went down.
+bool keyPressed(int key) {
+	static bool wasDown[GLFW_KEY_LAST + 1] = { false };
+	bool down = glfwGetKey(window, key) == GLFW_PRESS;
+	bool pressed = down && !wasDown[key];
+	wasDown[key] = down;
+	return pressed;
 }
 
 void handleInput() {
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
 		glfwSetWindowShouldClose(window, GLFW_TRUE);
 	}
+
+	// halve or double the resolution of the simulation grid.
+	// the governor then works relative to the new size.
+	bool resized = false;
+	if (keyPressed(GLFW_KEY_LEFT_BRACKET)) {
+		resizeGrid(gridWidth / 2, gridHeight / 2);
+		resized = true;
+	}
+	if (keyPressed(GLFW_KEY_RIGHT_BRACKET)) {
+		resizeGrid(gridWidth * 2, gridHeight * 2);
+		resized = true;
+	}
+	if (resized) {
+		baseGridWidth = gridWidth;
+		baseGridHeight = gridHeight;
+		quality.gridLevel = 0;
+	}
+
+	// print the GPU time of the passes, and how many GL calls a frame makes.
+	if (keyPressed(GLFW_KEY_P)) {
+		if (profiling) {
+			passProfiler.print();
+		}
+		printGlCallCounts();
+	}
+
+	// start or stop recording a trace.
+	if (keyPressed(GLFW_KEY_T)) {
+		if (traceEnabled()) {
+			stopTrace();
+		}
+		else {
+			startTrace();
+		}
+	}
 }
 
-GLuint createFloatTexture(float* data, GLint internalFormat, GLint format, GLenum type) {
+// with layeredFields every texture is a texture array, so that the same shaders and passes work for all the layers.
+// the fields have a layer per member, and everything else has a single layer. data has all the layers, one after another.
+// without it, every texture is a plain 2D texture, with a single layer.
+GLuint createFloatTexture(float* data, int width, int height, int layers, GLint internalFormat, GLint format, GLenum type) {
 	GLuint tex;
 
 	GL_C(glGenTextures(1, &tex));
-	GL_C(glBindTexture(GL_TEXTURE_2D, tex));
-	GL_C(glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, fbWidth, fbHeight, 0, format, type, data));
-	GL_C(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-	GL_C(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-	GL_C(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-	GL_C(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-	GL_C(glBindTexture(GL_TEXTURE_2D, 0));
+	selectTexture(tex);
+	if (!layeredFields) {
+		if (pglTexStorage2D != nullptr) {
+			GL_C(pglTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height));
+			if (data != nullptr) {
+				GL_C(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, data));
+			}
+		}
+		else {
+			GL_C(glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, data));
+		}
+	}
+	else if (pglTexStorage3D != nullptr) {
+		GL_C(pglTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, internalFormat, width, height, layers));
+		if (data != nullptr) {
+			GL_C(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, width, height, layers, format, type, data));
+		}
+	}
+	else {
+		GL_C(glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, width, height, layers, 0, format, type, data));
+	}
+	GL_C(glTexParameteri(textureTarget(), GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+	GL_C(glTexParameteri(textureTarget(), GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+	GL_C(glTexParameteri(textureTarget(), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+	GL_C(glTexParameteri(textureTarget(), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+	textureLayerCounts[tex] = layers;
 	
 	return tex;
 }
 
-GLuint loadJpgAsTexture(const char* filepath) {
-	FILE* fh = fopen(filepath, "rb");
-	if (fh == nullptr) {
-		printf("COULD NOT OPEN %s. Make sure it is in path\n", filepath);
-        exit(1);
+// find a file given on the command line, or one of the files that ship with the demo.
+std::string findAsset(const std::string& path) {
+	const char* prefixes[] = { "", "../" };
+	for (const char* prefix : prefixes) {
+		FILE* fh = fopen((prefix + path).c_str(), "rb");
+		if (fh != nullptr) {
+			fclose(fh);
+			return prefix + path;
+		}
 	}
-	
-	int width;
-	int height;
-	int depth;
-	GLubyte* bitmap = static_cast<GLubyte*>(stbi_load_from_file(fh, &width, &height,
-		&depth,
-		STBI_default));
-
-	GLint format = 0, internalFormat = 0;
-	
-	switch (depth) {
+	printf("COULD NOT OPEN %s. Make sure it is in path\n", path.c_str());
+	exit(1);
+}
 
-	case STBI_rgb: {
-		format = GL_RGB;
-		internalFormat = GL_RGB;
-		break;
+// upload an image that was already resampled to the size of the color field, and converted to linear color.
+GLuint createImageTexture(std::future<LinearImage>& image) {
+	LinearImage img = image.get();
+	if (img.width == 0) {
+		exit(1);
 	}
-	case STBI_rgb_alpha: {
-		format = GL_RGBA;
-		internalFormat = GL_RGBA;
+	return createFloatTexture(img.rgba.data(), img.width, img.height, 1, GL_RGBA32F, GL_RGBA, GL_FLOAT);
+}
 
-		break;
-	}
+// the formats that the fields can be stored in.
+struct TextureFormat {
+	const char* name;
+	GLint internalFormat;
+	GLint format;
+	int channels;
+	int bytesPerTexel;
+};
+
+const TextureFormat textureFormats[] = {
+	{ "rgba32f", GL_RGBA32F, GL_RGBA, 4, 16 },
+	{ "rgba16f", GL_RGBA16F, GL_RGBA, 4, 8 },
+	{ "r11g11b10f", GL_R11F_G11F_B10F, GL_RGB, 3, 4 },
+	{ "rg32f", GL_RG32F, GL_RG, 2, 8 },
+	{ "rg16f", GL_RG16F, GL_RG, 2, 4 },
+	{ "r32f", GL_R32F, GL_RED, 1, 4 },
+	{ "r16f", GL_R16F, GL_RED, 1, 2 },
+};
 
+enum FieldKind {
+	FIELD_VELOCITY,
+	FIELD_COLOR,
+	FIELD_PRESSURE,
+	FIELD_DIVERGENCE,
+	FIELD_KIND_COUNT
+};
+
+const char* const fieldKindNames[FIELD_KIND_COUNT] = { "velocity", "color", "pressure", "divergence" };
+// the channels that the shaders use. the color has no alpha, and the pressure and divergence are scalars.
+const int fieldKindChannels[FIELD_KIND_COUNT] = { 2, 3, 1, 1 };
+
+// note that we use RG32F to store the velocity fields. This is actually very important.
+// since fluid simulation is heavily bandwidth bound, using RG32F instead of RGBA32F essentially doubled the performance
+// in our measurments. the profiles below take that further, with half floats and the packed R11G11B10F for the color,
+// which has no sign bit, but the color is never negative.
+// "full" is as accurate as it gets, and the default. compare a profile against it with --dump and --compare.
+struct FormatProfile {
+	const char* name;
+	const char* formats[FIELD_KIND_COUNT];
+};
+
+const FormatProfile formatProfiles[] = {
+	{ "full", { "rg32f", "rgba32f", "r32f", "r32f" } },
+	{ "half", { "rg16f", "r11g11b10f", "r32f", "r16f" } },
+	{ "low", { "rg16f", "r11g11b10f", "r16f", "r16f" } },
+};
+
+std::string fieldFormats[FIELD_KIND_COUNT] = { "rg32f", "rgba32f", "r32f", "r32f" };
+
+const TextureFormat* findTextureFormat(const std::string& name) {
+	for (const TextureFormat& f : textureFormats) {
+		if (name == f.name) {
+			return &f;
+		}
 	}
-	
-	GLuint tex;
+	return nullptr;
+}
 
-	GL_C(glGenTextures(1, &tex));
-	GL_C(glBindTexture(GL_TEXTURE_2D, tex));
-	GL_C(glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, bitmap));
-	GL_C(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-	GL_C(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-	GL_C(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-	GL_C(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+const TextureFormat& fieldFormat(FieldKind kind) {
+	return *findTextureFormat(fieldFormats[kind]);
+}
 
-	return tex;
+// a list like half,pressure=r16f. a profile sets the formats of all fields, and the fields after it override it.
+bool setFieldFormats(const std::string& list) {
+	size_t begin = 0;
+	while (begin < list.size()) {
+		size_t end = list.find(',', begin);
+		if (end == std::string::npos) {
+			end = list.size();
+		}
+		std::string item = list.substr(begin, end - begin);
+		begin = end + 1;
+
+		size_t eq = item.find('=');
+		if (eq == std::string::npos) {
+			const FormatProfile* profile = nullptr;
+			for (const FormatProfile& p : formatProfiles) {
+				if (item == p.name) {
+					profile = &p;
+				}
+			}
+			if (profile == nullptr) {
+				printf("Unknown format profile %s\n", item.c_str());
+				return false;
+			}
+			for (int k = 0; k < FIELD_KIND_COUNT; ++k) {
+				fieldFormats[k] = profile->formats[k];
+			}
+			continue;
+		}
+
+		std::string field = item.substr(0, eq);
+		std::string format = item.substr(eq + 1);
+		int kind = 0;
+		while (kind < FIELD_KIND_COUNT && field != fieldKindNames[kind]) {
+			kind++;
+		}
+		if (kind == FIELD_KIND_COUNT) {
+			printf("Unknown field %s\n", field.c_str());
+			return false;
+		}
+		const TextureFormat* f = findTextureFormat(format);
+		if (f == nullptr || f->channels < fieldKindChannels[kind]) {
+			printf("The %s can not be stored as %s\n", field.c_str(), format.c_str());
+			return false;
+		}
+		fieldFormats[kind] = format;
+	}
+	return true;
 }
 
-void setupGraphics() {
-	initGlfw();
+struct GridTexture {
+	GLuint* tex;
+	const char* name;
+	FieldKind kind;
+	bool persistent;  // carried over from one simulation step to the next.
+	bool exported;    // read after the simulation step, by the rendering, the dumps or the diagnostics.
 
-	// create all textures.
-	{
-		float* zeroData = new float[fbWidth * fbHeight * 4];
-		for (int y = 0; y < fbHeight; ++y) {
-			for (int x = 0; x < fbWidth; ++x) {
-				zeroData[4 * (fbWidth * y + x) + 0] = 0.0f;
-				zeroData[4 * (fbWidth * y + x) + 1] = 0.0f;
-				zeroData[4 * (fbWidth * y + x) + 2] = 0.0f;
-				zeroData[4 * (fbWidth * y + x) + 3] = 0.0f;
+	// has the size of the color field, instead of the size of the grid.
+	bool dye() const { return kind == FIELD_COLOR; }
+};
+
+// every texture that has the size of the simulation grid, or of the color field.
+std::vector<GridTexture> gridTextures() {
+	return std::vector<GridTexture>{
+		{ &uTex, "velocity", FIELD_VELOCITY, true, false },
+		{ &wTex, "advected velocity", FIELD_VELOCITY, false, false },
+		{ &wTempTex, "forced velocity", FIELD_VELOCITY, false, false },
+		{ &wDivergenceTex, "divergence", FIELD_DIVERGENCE, false, true },
+		{ &pTempTex[0], "pressure 0", FIELD_PRESSURE, false, true },
+		{ &pTempTex[1], "pressure 1", FIELD_PRESSURE, false, true },
+		{ &cTex, "color", FIELD_COLOR, true, false },
+		{ &cTempTex, "advected color", FIELD_COLOR, false, false },
+	};
+}
+
+// the physical textures that the fields of gridTextures() are put in.
+// the format of a physical texture is the index of the first field in gridTextures() that has that format.
+CompiledGraph stepGraph;
+std::vector<GLuint> physicalTextures;
+std::vector<GLint> physicalInternalFormats;
+bool printStepGraph = false;
+
+// works out which fields can share a texture, and which have to be cleared before a pass.
+// the graph only depends on the passes and formats, so it is compiled once, and not again when the grid is resized.
+void compileStepGraph() {
+	std::vector<GridTexture> textures = gridTextures();
+	RenderGraph graph;
+	for (size_t i = 0; i < textures.size(); ++i) {
+		int formatClass = (int)i;
+		for (size_t j = 0; j < i; ++j) {
+			if (fieldFormat(textures[j].kind).internalFormat == fieldFormat(textures[i].kind).internalFormat &&
+				textures[j].dye() == textures[i].dye()) {
+				formatClass = (int)j;
+				break;
 			}
 		}
-		
-		// note that we use RG32F to store the velocity fields. This is actually very important.
-		// since fluid simulation is heavily bandwidth bound, using RG32F instead of RGBA32F essentially doubled the performance
-		// in our measurments.
-		cBegTex = createFloatTexture(zeroData, GL_RGBA32F, GL_RGBA, GL_FLOAT);
-		uBegTex = createFloatTexture(zeroData, GL_RG32F, GL_RG, GL_FLOAT);
-		uEndTex = createFloatTexture(zeroData, GL_RG32F, GL_RG, GL_FLOAT);
-		cEndTex = createFloatTexture(zeroData, GL_RGBA32F, GL_RGBA, GL_FLOAT);
-		cTempTex = createFloatTexture(zeroData, GL_RGBA32F, GL_RGBA, GL_FLOAT);
-		wTex = createFloatTexture(zeroData, GL_RG32F, GL_RG, GL_FLOAT);
-		wTempTex = createFloatTexture(zeroData, GL_RG32F, GL_RG, GL_FLOAT);
-		wDivergenceTex = createFloatTexture(zeroData, GL_RG32F, GL_RG, GL_FLOAT);
-		uEndTempTex = createFloatTexture(zeroData, GL_RG32F, GL_RG, GL_FLOAT);
-		pTempTex[0] = createFloatTexture(zeroData, GL_RG32F, GL_RG, GL_FLOAT);
-		pTempTex[1] = createFloatTexture(zeroData, GL_RG32F, GL_RG, GL_FLOAT);
-		
-		outTex = createFloatTexture(zeroData, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+		graph.addTexture(textures[i].name, formatClass, textures[i].persistent, textures[i].exported);
+	}
+
+	auto textureIndex = [&](GLuint* tex) {
+		for (size_t i = 0; i < textures.size(); ++i) {
+			if (textures[i].tex == tex) {
+				return (int)i;
+			}
+		}
+		printf("A pass of the simulation step uses a texture that is not in gridTextures()\n");
+		exit(1);
+	};
+	for (const StepPass& pass : stepPasses) {
+		std::vector<int> reads;
+		std::vector<int> writes;
+		for (GLuint* tex : pass.reads) {
+			reads.push_back(textureIndex(tex));
+		}
+		for (GLuint* tex : pass.writes) {
+			writes.push_back(textureIndex(tex));
+		}
+		graph.addPass(pass.scopes.back(), reads, writes);
+	}
 
-		monaTex = loadJpgAsTexture("../smallmona.jpg");
-		screamTex = loadJpgAsTexture("../smallscream.jpg");
+	stepGraph = graph.compile();
+	physicalTextures.assign(stepGraph.physicalFormat.size(), 0);
+	physicalInternalFormats.clear();
+	for (int formatClass : stepGraph.physicalFormat) {
+		physicalInternalFormats.push_back(fieldFormat(textures[formatClass].kind).internalFormat);
+	}
+	for (size_t p = 0; p < stepPasses.size(); ++p) {
+		stepPasses[p].clears.clear();
+		for (int t : stepGraph.clears[p]) {
+			stepPasses[p].clears.push_back(textures[t].tex);
+		}
+		stepPasses[p].invalidates.clear();
+		for (int t : stepGraph.invalidates[p]) {
+			// a pass that only runs on the active tiles leaves the inactive ones alone, and they must be zero.
+			if (sparseTiles && stepPasses[p].tiled) {
+				stepPasses[p].clears.push_back(textures[t].tex);
+			}
+			else {
+				stepPasses[p].invalidates.push_back(textures[t].tex);
+			}
+		}
 	}
-	
-	GL_C(glGenFramebuffers(1, &fbo0));
 
-	// all the shaders can just use the same vertex shader, 
-	// since all the shaders are basically rendering a fullscreen quad,
-	// and the actual logic is in the fragment shader. 
-	std::string fullscreenVs(R"(
-       layout(location = 0) in vec3 vsPos;
+	if (printStepGraph) {
+		graph.print(stepGraph);
+	}
+}
 
-        out vec2 fsUv;
+// the texels of a member of a field, at the current size of the grid and the color field, with the halos of the tiles.
+double fieldTexels(const GridTexture& t) {
+	if (t.dye()) {
+		return (double)dyeTextureWidth * dyeTextureHeight * dyeTilesX * dyeTilesY;
+	}
+	return (double)gridWidth * gridHeight;
+}
 
-        void main() {
-          fsUv = vsPos.xy;
-          gl_Position =  vec4(2.0 * vsPos.xy - vec2(1.0), 0.0, 1.0);
-        }
-		)");
-	
-	// size of a pixel.
-	std::string deltaCode = std::string("const vec2 delta = vec2(") + std::to_string(1.0f / float(fbWidth)) + std::string(",") + std::to_string(1.0f / float(fbHeight)) + ");\n";
-	
-	std::string defines = "";
-	defines += deltaCode; // common definitions that we append in the beginning of every shader. 
+// the memory of the physical textures.
+double textureBytes(int physical) {
+	const GridTexture& t = gridTextures()[stepGraph.physicalFormat[physical]];
+	return fieldTexels(t) * ensembleSize * fieldFormat(t.kind).bytesPerTexel;
+}
 
-	advectShader = loadNormalShader(
-		defines +
-		fullscreenVs,
-		defines +
-		std::string(R"(
+double totalTextureBytes() {
+	double bytes = 0.0;
+	for (size_t p = 0; p < physicalTextures.size(); ++p) {
+		bytes += textureBytes((int)p);
+	}
+	return bytes;
+}
 
-        in vec2 fsUv;
+// prints the formats and the memory of the fields. with --print-graph, also every texture, and the fields in it.
+void printTextureMemory() {
+	std::vector<GridTexture> textures = gridTextures();
+	const double MB = 1024.0 * 1024.0;
+	if (printStepGraph) {
+		printf("textures of the simulation step, at a %dx%d grid and a %dx%d color field:\n", gridWidth, gridHeight, dyeWidth, dyeHeight);
+		for (size_t p = 0; p < physicalTextures.size(); ++p) {
+			std::string fields;
+			for (size_t i = 0; i < textures.size(); ++i) {
+				if (stepGraph.physical[i] == (int)p) {
+					fields += fields.empty() ? textures[i].name : std::string(", ") + textures[i].name;
+				}
+			}
+			const GridTexture& t = textures[stepGraph.physicalFormat[p]];
+			printf("  %2d %-11s %7.2f MB  %s\n", (int)p, fieldFormat(t.kind).name, textureBytes((int)p) / MB, fields.c_str());
+		}
+	}
 
-        uniform sampler2D uuTex;
-        uniform sampler2D usTex;
+	if (ensembleSize > 1) {
+		printf("Ensemble of %d members, every field has a layer per member\n", ensembleSize);
+	}
+	if (dyeTiled()) {
+		printf("The color field has a layer per tile, of %dx%d texels with the halo\n", dyeTextureWidth, dyeTextureHeight);
+	}
+	double unsharedBytes = 0.0;
+	for (const GridTexture& t : textures) {
+		unsharedBytes += fieldTexels(t) * ensembleSize * fieldFormat(t.kind).bytesPerTexel;
+	}
+	printf("Field formats: velocity %s, color %s, pressure %s, divergence %s. %d fields in %d textures, %.1f MB (%.1f MB without sharing)\n",
+		fieldFormats[FIELD_VELOCITY].c_str(), fieldFormats[FIELD_COLOR].c_str(), fieldFormats[FIELD_PRESSURE].c_str(), fieldFormats[FIELD_DIVERGENCE].c_str(),
+		(int)textures.size(), (int)physicalTextures.size(), totalTextureBytes() / MB, unsharedBytes / MB);
+}
 
-        out vec4 FragColor;
+// the compute kernels need the format of the textures that they write.
+GLint textureInternalFormat(GLuint tex) {
+	for (size_t p = 0; p < physicalTextures.size(); ++p) {
+		if (physicalTextures[p] == tex) {
+			return physicalInternalFormats[p];
+		}
+	}
+	printf("Texture %u is not a field of the simulation\n", tex);
+	exit(1);
+}
 
-		void main()
-		{
-          // 1.0 / 60.0 is time step. 
-          vec2 tc = fsUv - delta * (1.0 / 60.0) * texture(uuTex, fsUv).xy;
-          FragColor = texture(usTex, tc);
+// the textures are allocated without data, and cleared on the GPU.
+// much cheaper than uploading zeros from the CPU.
+void allocatePhysicalTextures(bool dye) {
+	std::vector<GridTexture> textures = gridTextures();
+	for (size_t p = 0; p < physicalTextures.size(); ++p) {
+		const GridTexture& t = textures[stepGraph.physicalFormat[p]];
+		if (t.dye() != dye) {
+			continue;
+		}
+		int width = dye ? dyeTextureWidth : gridWidth;
+		int height = dye ? dyeTextureHeight : gridHeight;
+		int layers = dye ? ensembleSize * dyeTilesX * dyeTilesY : ensembleSize;
+		const TextureFormat& format = fieldFormat(t.kind);
+		physicalTextures[p] = createFloatTexture(nullptr, width, height, layers, format.internalFormat, format.format, GL_FLOAT);
+		clearTexture(physicalTextures[p]);
+	}
+	for (size_t i = 0; i < textures.size(); ++i) {
+		if (textures[i].dye() == dye) {
+			*textures[i].tex = stepGraph.physical[i] >= 0 ? physicalTextures[stepGraph.physical[i]] : 0;
+		}
+	}
+}
+
+void createGridTextures() {
+	allocatePhysicalTextures(false);
+	pTex = pTempTex[0];
+
+	// every tile is active until the tiles are found for the first time.
+	tilesX = (gridWidth + ACTIVE_TILE_SIZE - 1) / ACTIVE_TILE_SIZE;
+	tilesY = (gridHeight + ACTIVE_TILE_SIZE - 1) / ACTIVE_TILE_SIZE;
+	std::vector<float> ones(tilesX * tilesY * ensembleSize, 1.0f);
+	tileActivityTex = createFloatTexture(nullptr, tilesX, tilesY, ensembleSize, GL_R32F, GL_RED, GL_FLOAT);
+	activeTilesTex = createFloatTexture(ones.data(), tilesX, tilesY, ensembleSize, GL_R32F, GL_RED, GL_FLOAT);
+}
 
+void deleteGridTextures() {
+	std::vector<GridTexture> textures = gridTextures();
+	for (size_t p = 0; p < physicalTextures.size(); ++p) {
+		if (!textures[stepGraph.physicalFormat[p]].dye()) {
+			deleteTexture(&physicalTextures[p]);
 		}
-		)")
-	);
-	asuTexLocation = glGetUniformLocation(advectShader, "uuTex");
-	assTexLocation = glGetUniformLocation(advectShader, "usTex");
+	}
+	for (const GridTexture& t : textures) {
+		if (!t.dye()) {
+			*t.tex = 0;
+		}
+	}
+	deleteTexture(&tileActivityTex);
+	deleteTexture(&activeTilesTex);
+	invalidateGlState();
+}
 
-	jacobiShader = loadNormalShader(
-		defines +
-		fullscreenVs,
-		defines +
-		std::string(R"(
+// create all textures.
+void createTextures() {
+	// the color field has a layer for every tile of every member.
+	GLint maxLayers;
+	GL_C(glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers));
+	int maxMembers = std::max((int)maxLayers / (dyeTilesX * dyeTilesY), 1);
+	if (ensembleSize > maxMembers) {
+		printf("The ensemble can have at most %d members\n", maxMembers);
+		ensembleSize = maxMembers;
+	}
+	// the tiles of --sparse-tiles are tiles of the grid, and the passes of a tiled color field draw its own tiles instead.
+	if (sparseTiles && dyeTiled()) {
+		printf("--sparse-tiles does not work with a tiled color field, and is turned off\n");
+		sparseTiles = false;
+	}
+	std::vector<float> ones(ensembleSize, 1.0f);
+	allTilesTex = createFloatTexture(ones.data(), 1, 1, ensembleSize, GL_R32F, GL_RED, GL_FLOAT);
 
-        in vec2 fsUv;
+	compileStepGraph();
+	createGridTextures();
+	allocatePhysicalTextures(true);
+	printTextureMemory();
+}
 
-        uniform sampler2D uxTex;
-        uniform sampler2D ubTex;
+// render src into dst, where the two may have different sizes. the values are multiplied by scale.
+void resampleTexture(GLuint src, GLuint dst, float scaleX, float scaleY) {
+	attachTexture(dst);
 
-        uniform vec2 uBeta;
-        uniform vec2 uAlpha;
+	useProgram(resampleShader);
 
-        out vec4 FragColor;
+	setUniform1i(rssTexLocation, 0);
+	bindTexture(0, src);
 
-		void main()
-		{
-          vec4 xR = texture(uxTex, fsUv + vec2(+1, +0) * delta);
-          vec4 xL = texture(uxTex, fsUv + vec2(-1, +0) * delta);
-          vec4 xT = texture(uxTex, fsUv + vec2(+0, +1) * delta);
-          vec4 xB = texture(uxTex, fsUv + vec2(+0, -1) * delta);
+	setUniform4f(rsScaleLocation, scaleX, scaleY, 1.0f, 1.0f);
 
-          vec4 bC = vec4(texture(ubTex, fsUv).x);
+	renderFullscreen();
+}
 
-          FragColor = (xR + xL + xT + xB + vec4(uAlpha.xy, 0.0, 0.0) * bC) * vec4(uBeta.xy, 0.0, 0.0);
-		}
-		)")
-	);
-	jsxTexLocation = glGetUniformLocation(jacobiShader, "uxTex");
-	jsbTexLocation = glGetUniformLocation(jacobiShader, "ubTex");
-	jsBetaLocation = glGetUniformLocation(jacobiShader, "uBeta");
-	jsAlphaLocation = glGetUniformLocation(jacobiShader, "uAlpha");
+// resize the simulation grid, while the simulation is running.
+// the current velocity is resampled to the new size. all other fields of the grid are recomputed from scratch
+// every frame, so they are simply reallocated. the color field keeps its size.
+void resizeGrid(int w, int h) {
+	GLint maxSize;
+	GL_C(glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize));
+	w = std::min(std::max(w, 16), (int)maxSize);
+	h = std::min(std::max(h, 16), (int)maxSize);
+	if (w == gridWidth && h == gridHeight) {
+		return;
+	}
+	if (fieldDump.isOpen()) {
+		// all frames of a dump file have the same size.
+		printf("The grid can not be resized while fields are dumped\n");
+		return;
+	}
 
-	divergenceShader = loadNormalShader(
-		defines +
-		fullscreenVs,
-		defines +
-		std::string(R"(
+	// the velocity is measured in grid cells per second, so it has to be scaled along with the grid.
+	float scaleX = float(w) / float(gridWidth);
+	float scaleY = float(h) / float(gridHeight);
 
-        in vec2 fsUv;
+	// the old velocity is kept, to resample it to the new grid.
+	GLuint oldU = uTex;
+	std::replace(physicalTextures.begin(), physicalTextures.end(), oldU, 0u);
+	deleteGridTextures();
 
-        uniform sampler2D uwTex;
+	gridWidth = w;
+	gridHeight = h;
+	createGridTextures();
 
-        out vec4 FragColor;
-	
-		void main()
-		{
-          vec4 wR = texture(uwTex, fsUv + vec2(+1, +0) * delta);
-          vec4 wL = texture(uwTex, fsUv + vec2(-1, +0) * delta);
-          vec4 wT = texture(uwTex, fsUv + vec2(+0, +1) * delta);
-          vec4 wB = texture(uwTex, fsUv + vec2(+0, -1) * delta);
+	setViewport(gridWidth, gridHeight);
+	resampleTexture(oldU, uTex, scaleX, scaleY);
+	deleteTexture(&oldU);
+	invalidateGlState();
 
-          FragColor = vec4(0.5 * (wR.x - wL.x) + 0.5 * (wT.y - wB.y));
-       
-		}
-		)")
-	);
-	dswTexLocation = glGetUniformLocation(divergenceShader, "uwTex");
+	printf("Resized the grid to %dx%d\n", gridWidth, gridHeight);
+}
 
-	gradientSubtractionShader = loadNormalShader(
-		defines +
-		fullscreenVs,
-		defines +
-		std::string(R"(
+bool initFrameTimer() {
+	pglGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)glfwGetProcAddress("glGetQueryObjectui64v");
+	if (pglGetQueryObjectui64v == nullptr) {
+		return false;
+	}
+	GL_C(glGenQueries(FRAME_QUERY_COUNT, frameQueries));
+	return true;
+}
 
-        in vec2 fsUv;
+// returns false if all queries are still in flight, in which case the frame is not measured.
+bool beginFrameTimer() {
+	if (frameQueriesIssued - frameQueriesRead == FRAME_QUERY_COUNT) {
+		return false;
+	}
+	GL_C(glBeginQuery(GL_TIME_ELAPSED, frameQueries[frameQueriesIssued % FRAME_QUERY_COUNT]));
+	return true;
+}
 
-        uniform sampler2D upTex;
-        uniform sampler2D uwTex;
+void endFrameTimer() {
+	GL_C(glEndQuery(GL_TIME_ELAPSED));
+	frameQueriesIssued++;
+}
 
-        out vec4 FragColor;
+// GPU time of the oldest measured frame, if the GPU is done with it.
+bool readFrameTimer(double* ms) {
+	if (frameQueriesRead == frameQueriesIssued) {
+		return false;
+	}
+	GLuint query = frameQueries[frameQueriesRead % FRAME_QUERY_COUNT];
+	GLint available = 0;
+	GL_C(glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available));
+	if (!available) {
+		return false;
+	}
+	GLuint64 ns = 0;
+	GL_C(pglGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns));
+	frameQueriesRead++;
+	*ms = double(ns) / 1.0e6;
+	return true;
+}
 
-		void main()
-		{
-          vec4 pR = texture(upTex, fsUv + vec2(+1, +0) * delta);
-          vec4 pL = texture(upTex, fsUv + vec2(-1, +0) * delta);
-          vec4 pT = texture(upTex, fsUv + vec2(+0, +1) * delta);
-          vec4 pB = texture(upTex, fsUv + vec2(+0, -1) * delta);
+void startGovernor() {
+	if (!initFrameTimer()) {
+		printf("Timer queries are not supported, so the frame time can not be governed\n");
+		return;
+	}
+	if (fieldDump.isOpen()) {
+		// all frames of a dump file have the same size.
+		qualityBounds.maxGridLevel = 0;
+	}
+	governor.start(targetFrameMs, qualityBounds);
+}
+
+// hand the GPU times of all finished frames to the governor, and apply what it decides.
+void updateGovernor() {
+	double ms;
+	while (readFrameTimer(&ms)) {
+		int oldLevel = quality.gridLevel;
+		if (governor.update(ms, quality) && quality.gridLevel != oldLevel) {
+			resizeGrid(gridSizeAtLevel(baseGridWidth, quality.gridLevel), gridSizeAtLevel(baseGridHeight, quality.gridLevel));
+		}
+	}
+}
+
+// the programs, and the files in shaders/ that they are built from. the vertex shader of a compute program is
+// the compute shader, and it has no fragment shader. only the programs of an ensemble, or of a tiled color field,
+// have a geometry shader.
+struct ShaderProgram {
+	GLuint* program;
+	std::string vsFile;
+	std::string fsFile;
+	std::string gsFile;
+	// every file that the current program was built from, including the included ones. see reloadShaders().
+	std::vector<std::string> files;
+
+	ShaderProgram(GLuint* program_, const std::string& vsFile_, const std::string& fsFile_)
+		: program(program_), vsFile(vsFile_), fsFile(fsFile_) {
+	}
+};
+std::vector<ShaderProgram> shaderPrograms;
+
+// the directory of the shaders, which is looked for like the images, see findAsset().
+std::string shaderDir = "";
+
+// prints the error, and returns false, if a file is missing.
+bool loadProgramSources(const ShaderProgram& sp, ShaderSource* vs, ShaderSource* gs, ShaderSource* fs) {
+	std::string error;
+	if (!loadShaderSource(shaderDir, sp.vsFile, vs, &error) || (sp.gsFile != "" && !loadShaderSource(shaderDir, sp.gsFile, gs, &error)) ||
+		(sp.fsFile != "" && !loadShaderSource(shaderDir, sp.fsFile, fs, &error))) {
+		printf("%s\n", error.c_str());
+		return false;
+	}
+	return true;
+}
+
+std::vector<std::string> programFiles(const PendingProgram& p) {
+	std::vector<std::string> files = p.vsSource.files;
+	files.insert(files.end(), p.gsSource.files.begin(), p.gsSource.files.end());
+	files.insert(files.end(), p.fsSource.files.begin(), p.fsSource.files.end());
+	return files;
+}
+
+void createShaders() {
+	std::string frameFile = findAsset("shaders/frame.glsl");
+	shaderDir = frameFile.substr(0, frameFile.size() - strlen("/frame.glsl"));
+
+	shaderPrograms = {
+		{ &advectShader, "fullscreen.vert", "advect.frag" },
+		{ &jacobiShader, "fullscreen.vert", "jacobi.frag" },
+		{ &divergenceShader, "fullscreen.vert", "divergence.frag" },
+		{ &gradientSubtractionShader, "fullscreen.vert", "gradient_subtraction.frag" },
+		{ &forceShader, "fullscreen.vert", "force.frag" },
+		{ &addColorShader, "fullscreen.vert", "add_color.frag" },
+		{ &writeTexShader, "write_tex.vert", "write_tex.frag" },
+		{ &resampleShader, "fullscreen.vert", "resample.frag" },
+		{ &reduceShader, "fullscreen.vert", "reduce.frag" },
+		{ &visShader, "fullscreen.vert", "vis.frag" },
+		{ &tileActivityShader, "fullscreen.vert", "tile_activity.frag" },
+		{ &tileDilationShader, "fullscreen.vert", "tile_dilation.frag" },
+	};
+	// the instance of every member, or of every tile of the color field, is sent to its layer by a geometry shader.
+	if (layeredFields) {
+		for (ShaderProgram& sp : shaderPrograms) {
+			sp.gsFile = "layered.geom";
+		}
+	}
+	if (backend == BACKEND_COMPUTE) {
+		std::vector<ShaderProgram> kernels = {
+			{ &advectKernel.program, "advect.comp", "" },
+			{ &divergenceKernel.program, "divergence.comp", "" },
+			{ &jacobiKernel.program, "jacobi.comp", "" },
+			{ &gradientSubtractionKernel.program, "gradient_subtraction.comp", "" },
+			{ &forceKernel.program, "force.comp", "" },
+			{ &addColorKernel.program, "add_color.comp", "" },
+		};
+		shaderPrograms.insert(shaderPrograms.end(), kernels.begin(), kernels.end());
+	}
 
-          vec4 c =  texture(uwTex, fsUv);
-          c.xy -= vec2(0.5 * (pR.x - pL.x), 0.5 * (pT.y - pB.y));
-          FragColor = c;
+	for (ShaderProgram& sp : shaderPrograms) {
+		ShaderSource vs, gs, fs;
+		if (!loadProgramSources(sp, &vs, &gs, &fs)) {
+			exit(1);
 		}
-		)")
-	);
+		PendingProgram p = submitProgram(vs, gs, fs);
+		*sp.program = p.program;
+		sp.files = programFiles(p);
+		pendingPrograms.push_back(p);
+	}
+}
+
+// uniform locations and blocks can only be looked up once a program is linked.
+void getUniformLocations() {
+	asuTexLocation = glGetUniformLocation(advectShader, "uuTex");
+	assTexLocation = glGetUniformLocation(advectShader, "usTex");
+	asTiledDyeLocation = glGetUniformLocation(advectShader, "uTiledDye");
+
+	jsxTexLocation = glGetUniformLocation(jacobiShader, "uxTex");
+	jsbTexLocation = glGetUniformLocation(jacobiShader, "ubTex");
+
+	dswTexLocation = glGetUniformLocation(divergenceShader, "uwTex");
+
 	gsspTexLocation = glGetUniformLocation(gradientSubtractionShader, "upTex");
 	gsswTexLocation = glGetUniformLocation(gradientSubtractionShader, "uwTex");
 
-	// in order to make interesting simulations, 
-	// we place out emitters that add colors and forces to different locations.
-	// this self-contained string contains all the emitter logic.,
-	// for all the four simulations.
-	std::string emitterCode = std::string(R"(
-vec2 F;
-vec3 C;
-in vec2 fsUv;
+	fswTexLocation = glGetUniformLocation(forceShader, "uwTex");
+
+	accTexLocation = glGetUniformLocation(addColorShader, "ucTex");
+	acTiledDyeLocation = glGetUniformLocation(addColorShader, "uTiledDye");
 
-uniform float uCounter;
-uniform int uSim;
+	wtcTexLocation = glGetUniformLocation(writeTexShader, "ucTex");
+	wtOffsetLocation = glGetUniformLocation(writeTexShader, "uOffset");
+	wtSizeLocation = glGetUniformLocation(writeTexShader, "uSize");
+	wtTiledDyeLocation = glGetUniformLocation(writeTexShader, "uTiledDye");
 
-vec2 uForce;
-vec2 uPos;
-vec3 uColor;
-float uRad;
+	rssTexLocation = glGetUniformLocation(resampleShader, "usTex");
+	rsScaleLocation = glGetUniformLocation(resampleShader, "uScale");
 
-float hash(float n)
-{
-  return fract(sin(n)*43758.5453123);
+	rdaTexLocation = glGetUniformLocation(reduceShader, "uaTex");
+	rdbTexLocation = glGetUniformLocation(reduceShader, "ubTex");
+	rdcTexLocation = glGetUniformLocation(reduceShader, "ucTex");
+	rdModeLocation = glGetUniformLocation(reduceShader, "uMode");
+	rdSizeLocation = glGetUniformLocation(reduceShader, "uSize");
+	rdBlockLocation = glGetUniformLocation(reduceShader, "uBlock");
+
+	vsTexLocation = glGetUniformLocation(visShader, "uTex");
+	vsBicubicLocation = glGetUniformLocation(visShader, "uBicubic");
+
+	tawTexLocation = glGetUniformLocation(tileActivityShader, "uwTex");
+	tacTexLocation = glGetUniformLocation(tileActivityShader, "ucTex");
+	taThresholdLocation = glGetUniformLocation(tileActivityShader, "uThreshold");
+	taTileCountLocation = glGetUniformLocation(tileActivityShader, "uTileCount");
+
+	tdaTexLocation = glGetUniformLocation(tileDilationShader, "uaTex");
+	tdRadiusLocation = glGetUniformLocation(tileDilationShader, "uRadius");
+
+	GLuint programs[] = { advectShader, jacobiShader, divergenceShader, gradientSubtractionShader, forceShader, addColorShader,
+		writeTexShader, resampleShader, reduceShader, visShader, tileActivityShader, tileDilationShader };
+	for (GLuint program : programs) {
+		bindFrameUniformBlock(program);
+		// the vertex shader reads the tiles to render from TILE_UNIT, see renderFullscreen(). the unit of a sampler
+		// is part of the program, so it is only set once.
+		GLint tilesLocation = glGetUniformLocation(program, "uTiles");
+		if (tilesLocation != -1) {
+			useProgram(program);
+			setUniform1i(tilesLocation, TILE_UNIT);
+		}
+	}
+	if (backend == BACKEND_COMPUTE) {
+		ComputeKernel* kernels[] = { &advectKernel, &divergenceKernel, &jacobiKernel, &gradientSubtractionKernel, &forceKernel, &addColorKernel };
+		for (ComputeKernel* kernel : kernels) {
+			bindFrameUniformBlock(kernel->program);
+			GLint groupSize[3];
+			GL_C(glGetProgramiv(kernel->program, GL_COMPUTE_WORK_GROUP_SIZE, groupSize));
+			kernel->groupWidth = groupSize[0];
+			kernel->groupHeight = groupSize[1];
+			kernel->tiledDyeLocation = glGetUniformLocation(kernel->program, "uTiledDye");
+		}
+	}
 }
 
-float mynoise(in vec2 x)
-{
-  vec2 p = floor(x);
-  vec2 f = fract(x);
-  
-  f = f*f*(3.0-2.0*f);
-  
-  float n = p.x + p.y*57.0;
-  float res = mix(mix(hash(n+  0.0), hash(n+  1.0), f.x),
-                  mix(hash(n+ 57.0), hash(n+ 58.0), f.x), f.y);
-  return res;
-}
-
-vec3 pal( in float t, in vec3 a, in vec3 b, in vec3 c, in vec3 d )
-{
-  return a + b*cos( 6.28318*(c*t+d) );
-}
-
-float quarticIn(float t) {
-  return pow(t, 4.0);
-}
-
-vec3 colorize(float t, vec2 uv) {
-  float p = 0.2;
-  vec3 col = vec3(0.0, 0.0, 0.0);
-
-  t += float(uCounter) / 200;
-  col = 1.2 * pal( t, vec3(0.5,0.5,0.5),vec3(0.5,0.5,0.5),vec3(1.0,1.0,1.0),vec3(0.0,0.33,0.67) );
-
-  return col;
-}
-
-void rainbowEmit() {
-  float t = 2.0f * float(uCounter) / 500.0f;
-
-  float b;
-  b = 0.0 * 3.14 + 0.35f * sin(40.0f * t + 5.4 * hash(float(uCounter)/300.0)  );
-  uForce= vec2(9.2 * 60.0f * sin(b), 9.2 * 60.0 *  cos(b));
-  uPos = vec2(0.5 + 0.05*sin(float(uCounter)/10.0), 0.1);
-  uColor = vec3(0.5f, 0.0, 0.0);
-  uRad = 0.02f;
-  
-  float dist = distance(fsUv, uPos);
-  t = max(uRad - dist, 0.0)/uRad;
-
-  F +=  (t) * uForce;
-  if(uRad - dist > 0.0) C = colorize(t, fsUv);
-}
-
-// idea, do this emitter in a circle.
-void emit(vec2 eDir, vec2 ePos, vec3 pa, vec3 pb, vec3 pc, vec3 pd) {
-
-  uRad = 0.005f;
-  uColor = vec3(1.0, 0.0, 0.0);
-  uPos = ePos+ eDir * float(uCounter) / 500.0f;
-  uForce = eDir * 70.0 + 100.0 * (-1.0 + 2.0* mynoise(300.0 *  uPos));
-
-  float dist = distance(fsUv, uPos);
-  float t = max(uRad - dist, 0.0)/uRad;
-
-  F +=  (t) * uForce;
- 
-  {
-    float p = 0.2;
-    vec3 col = vec3(0.0, 0.0, 0.0);
-    float tt = t;
-    tt += float(uCounter) / 200;
-  
-    col = 0.6 * pal( 1.0 * tt, pa, pb, pc, pd );
-  
-    if(uRad - dist > 0.0) C += col;
-  
-    dist = distance(fsUv,  ePos - 0.1 * eDir + eDir * (float(uCounter) / 500.0f)  );
-    t = max(uRad - dist, 0.0)/uRad;
-    float theta = 0.0f + 3.14 * 2.0 * mynoise(300.0 *  uPos);
-    F +=  (t) * 70.0 * vec2(cos(theta), sin(theta));
-  }
-}
-
-void circleEmitter() {
-  int N = 14;
-  for(int i = 0; i < N; ++i) {
-    float theta = 2.0 * 3.14 *  i / float(N);
-    vec2 pos = vec2(0.5, 0.5) + 0.3 * vec2(cos(theta) , sin(theta));
-    vec2 dir = -vec2(cos(theta) , sin(theta));
-
-    int j = i % 6;
-    if(j == 0) {
-      emit(dir, pos, vec3(0.5,0.5,0.5),vec3(0.5,0.5,0.5),vec3(1.0,1.0,1.0),vec3(0.0,0.33,0.67));
-    } else if(j == 1) {
-      emit(dir, pos, vec3(0.5,0.5,0.5),vec3(0.5,0.5,0.5),vec3(1.2,0.3,1.0),vec3(0.4,0.33,0.27));
-    } else if(j == 2) {
-      emit(dir, pos,vec3(0.5,0.5,0.5),vec3(0.5,0.5,0.5),vec3(0.4,0.3,0.3),vec3(0.8,0.9,0.28));
-    }else if(j == 3) {
-      emit(dir, pos,  vec3(0.5,0.5,0.5),vec3(0.5,0.5,0.5),vec3(1.3,0.7,0.4),vec3(3.46,0.8,0.17));
-    } else if(j == 4) {
-      emit(dir, pos,  vec3(0.5,0.5,0.5),vec3(0.5,0.5,0.5),vec3(0.3,0.2,1.2),vec3(1.46,1.1,0.57));
-    }else if(j == 5) {
-      emit(dir, pos,  vec3(0.5,0.5,0.5),vec3(0.5,0.5,0.5),vec3(0.8,1.1,0.7),vec3(0.15,0.1,0.03));
-    }
-  }
-}
-
-void screamEmitter(vec2 ePos, vec2 eDir, float myc) {
-   
-
-  uRad = 0.002f;
-  uColor = vec3(1.0, 0.0, 0.0);
-  uPos = ePos+ eDir * float(myc) / 500.0f;
-  uForce = eDir * 70.0 + 100.0 * (-1.0 + 2.0* mynoise(300.0 *  uPos));
-
-  float dist = distance(fsUv, uPos);
-  float t = max(uRad - dist, 0.0)/uRad;
-
-  F +=  (t) * uForce;
-
-  {
-    float p = 0.2;
-    float tt = t;
-    tt += float(myc) / 200;
-   
-    dist = distance(fsUv,  ePos - 0.1 * eDir + eDir * (float(myc) / 500.0f)  );
-    t = max(uRad - dist, 0.0)/uRad;
-    float theta = 0.0f + 3.14 * 2.0 * mynoise(300.0 *  uPos);
-    F +=  (t) * 1.0 * vec2(cos(theta), sin(theta));
-  }
-}
-
-void monaLisa() {
-  if(uCounter > 3) {
-   
-    uRad = 0.005f;
-    uColor = vec3(1.0, 0.0, 0.0);
-    vec2 ePos = vec2(0.1, 0.5);
-    vec2 eDir = normalize(vec2(0.5, 0.5));
-    for(float x = 0.02; x < 0.98; x += 0.05) {
-      for(float y = 0.02; y < 0.98; y += 0.05) {
-        uPos = vec2(x, y);
-        float theta = 0.0f + 3.14 * 2.0 * mynoise(300.0 *  uPos + vec2(uCounter / 200.0) );
-        uForce = 1.0 * vec2(cos(theta), sin(theta));
-        float dist = distance(fsUv, uPos);
-        float t = max(uRad - dist, 0.0)/uRad;
-        F +=  (t) * uForce;
-      }
-    }
-  }
-}
-
-void theScream() {
-  if(uCounter > 3) {
-   screamEmitter(vec2(0.5, 0.5), normalize(vec2(0.4, 0.8)), uCounter-3);   
-  }
-  if(uCounter > 60) {
-   screamEmitter(vec2(0.3, 0.3), normalize(vec2(-0.2, 0.4)), uCounter-60);   
-  }
-  if(uCounter > 90) {
-   screamEmitter(vec2(+0.8, 0.2), normalize(vec2(-0.4, +0.4)), uCounter-90);   
-  }
-  if(uCounter > 130) {
-   screamEmitter(vec2(+0.5, 0.96), normalize(vec2(0.1, -1.0)), uCounter-130);   
-  }
-  if(uCounter > 160) {
-   screamEmitter(vec2(+0.1, 0.1), normalize(vec2(0.3, +0.08)), uCounter-160);   
-  }
-  
-  if(uCounter > 200) {
-   screamEmitter(vec2(+0.19, 0.98), normalize(vec2(0.1, -0.4)), uCounter-200);   
-  }
-  if(uCounter > 250) {
-   screamEmitter(vec2(+0.01, 0.01), normalize(vec2(0.1, 0.1)), uCounter-250);   
-  }
-  if(uCounter > 300) {
-   screamEmitter(vec2(+0.8, 0.1), normalize(vec2(-0.1, 0.8)), uCounter-300);   
-  }
-  
-  if(uCounter > 320) {
-   screamEmitter(vec2(+0.2, 0.9), normalize(vec2(0.0, -0.1)), uCounter-320);   
-  }
-  
-  if(uCounter > 330) {
-   screamEmitter(vec2(+0.5, 0.5), normalize(vec2(-0.6, 0.0)), uCounter-330);   
-  }
-  
-  if(uCounter > 350) {
-   screamEmitter(vec2(+0.1, 0.8), normalize(vec2(1.0, 0.0)), uCounter-350);   
-  }
-  if(uCounter > 360) {
-   screamEmitter(vec2(+0.1, 0.1), normalize(vec2(1.0, 0.0)), uCounter-360);   
-  }
-  if(uCounter > 380) {
-   screamEmitter(vec2(+0.9, 0.9), normalize(vec2(-1.0, 0.0)), uCounter-380);   
-  }
-  
-  if(uCounter > 400) {
-   screamEmitter(vec2(+0.5, 0.04), normalize(vec2(0.0, 0.9)), uCounter-400);   
-  }
-  if(uCounter > 420) {
-   screamEmitter(vec2(+0.89, 0.9), normalize(vec2(0.0, -0.9)), uCounter-420);   
-  }
-  
-  if(uCounter > 440) {
-   screamEmitter(vec2(+0.11, 0.1), normalize(vec2(0.0, +0.9)), uCounter-440);   
-  }
-}
-
-void emitter() {
-
-  if(uSim == 0) {
-    circleEmitter();  
-  } else if(uSim == 2) {
-    monaLisa();
-  } else if(uSim == 4) {
-    theScream();
-  } else if(uSim == 5) {
-    rainbowEmit();
-  }
-
-}
-
-)");
-
-    // shader that applies forces from the emitters.
-	forceShader = loadNormalShader(
-	    defines +
-		fullscreenVs,
-		defines +
-		emitterCode +
-		std::string(R"(
-
-
-        uniform sampler2D uwTex;
-
-        out vec4 FragColor;
-
-		void main()
-		{
-          F = vec2(0.0, 0.0);
-          emitter();
-          FragColor = vec4(F.xy, 0.0, 0.0) + texture(uwTex, fsUv);
+// --watch-shaders reloads the shaders when their files change, so they can be tuned while the demo runs.
+bool watchShaders = false;
+FileWatcher shaderWatcher;
+
+// the programs that were resubmitted after a change, and whose old programs are still in use.
+struct ProgramReload {
+	size_t index; // in shaderPrograms.
+	PendingProgram pending;
+};
+std::vector<ProgramReload> programReloads;
+bool programReloadFailed = false;
+
+void watchShaderFiles() {
+	std::vector<std::string> files;
+	for (const ShaderProgram& sp : shaderPrograms) {
+		files.insert(files.end(), sp.files.begin(), sp.files.end());
+	}
+	shaderWatcher.watch(files);
+}
+
+// called between frames. only the programs that were built from a file that changed are resubmitted,
+// and the driver compiles them in the background, while the old programs keep running. once all of them
+// are compiled, they are swapped in together, so a frame never mixes old and new shaders.
+// if any of them fails, the errors are printed, and all the old programs are kept.
+void reloadShaders() {
+	std::vector<std::string> changed = shaderWatcher.takeChanged();
+	for (size_t i = 0; i < shaderPrograms.size() && !changed.empty(); ++i) {
+		const ShaderProgram& sp = shaderPrograms[i];
+		bool affected = false;
+		for (const std::string& file : changed) {
+			affected = affected || std::find(sp.files.begin(), sp.files.end(), file) != sp.files.end();
+		}
+		if (!affected) {
+			continue;
 		}
-		)")
-	);
-	fswTexLocation = glGetUniformLocation(forceShader, "uwTex");
-	fsCounterLocation = glGetUniformLocation(forceShader, "uCounter");
-	fsSimLocation = glGetUniformLocation(forceShader, "uSim");
 
-	// shader that adds the colors from the emitters.
-	addColorShader = loadNormalShader(
-		defines +
-		fullscreenVs,
-		defines +
-		emitterCode +
-		std::string(R"(
+		// a program that is still compiling is out of date already.
+		for (size_t r = 0; r < programReloads.size(); ++r) {
+			if (programReloads[r].index == i) {
+				// the shaders are only flagged for deletion while they are attached, and go away with the program.
+				const PendingProgram& old = programReloads[r].pending;
+				if (old.vs != 0) {
+					GL_C(glDeleteShader(old.vs));
+				}
+				if (old.gs != 0) {
+					GL_C(glDeleteShader(old.gs));
+				}
+				if (old.fs != 0) {
+					GL_C(glDeleteShader(old.fs));
+				}
+				GL_C(glDeleteProgram(old.program));
+				programReloads.erase(programReloads.begin() + r);
+				break;
+			}
+		}
 
-        uniform sampler2D ucTex;
+		ShaderSource vs, gs, fs;
+		if (!loadProgramSources(sp, &vs, &gs, &fs)) {
+			programReloadFailed = true;
+			continue;
+		}
+		programReloads.push_back(ProgramReload{ i, submitProgram(vs, gs, fs) });
+	}
 
-        out vec4 FragColor;
+	if (programReloads.empty() && !programReloadFailed) {
+		return;
+	}
+	// without KHR_parallel_shader_compile, checkProgram() waits for the compiler.
+	if (parallelShaderCompile) {
+		for (const ProgramReload& r : programReloads) {
+			GLint done = GL_TRUE;
+			if (r.pending.vs != 0) {
+				GL_C(glGetProgramiv(r.pending.program, GL_COMPLETION_STATUS_KHR, &done));
+			}
+			if (!done) {
+				return;
+			}
+		}
+	}
 
-		void main()
-		{
-          C = vec3(0.0, 0.0, 0.0);
-          emitter();
-          FragColor = vec4(C.rgb, 0.0) + texture(ucTex, fsUv);
+	bool ok = !programReloadFailed;
+	for (ProgramReload& r : programReloads) {
+		ok = checkProgram(r.pending) && ok;
+	}
+	for (ProgramReload& r : programReloads) {
+		ShaderProgram& sp = shaderPrograms[r.index];
+		if (ok) {
+			GL_C(glDeleteProgram(*sp.program));
+			*sp.program = r.pending.program;
+			sp.files = programFiles(r.pending);
+			printf("reloaded %s%s\n", sp.vsFile.c_str(), sp.fsFile != "" ? (" and " + sp.fsFile).c_str() : "");
 		}
-		)")
-	);
-	accTexLocation = glGetUniformLocation(addColorShader, "ucTex");
-	acCounterLocation = glGetUniformLocation(addColorShader, "uCounter");
-	acSimLocation = glGetUniformLocation(addColorShader, "uSim");
+		else {
+			GL_C(glDeleteProgram(r.pending.program));
+		}
+	}
+	if (ok) {
+		// the new programs can have the names of the old ones, and none of their uniforms are set.
+		invalidateGlState();
+		getUniformLocations();
+	}
+	else {
+		printf("the shaders could not be reloaded, so the previous ones are kept\n");
+	}
+	fflush(stdout);
+	programReloads.clear();
+	programReloadFailed = false;
+	// the includes may have changed.
+	watchShaderFiles();
+}
 
-	// write a texture at some specified place.
-	writeTexShader = loadNormalShader(
-		//vertDefines +
+// the GL state that never changes. everything is rendered with the fullscreen quad, and without depth testing or blending.
+void setDefaultGlState() {
+	GL_C(glDisable(GL_DEPTH_TEST));
+	GL_C(glDepthMask(false));
+	GL_C(glDisable(GL_BLEND));
+	GL_C(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+	GL_C(glEnable(GL_CULL_FACE));
+	GL_C(glFrontFace(GL_CCW));
+	GL_C(glDepthFunc(GL_LESS));
 
-		R"(
-		layout(location = 0) in vec3 vsPos;
+	GL_C(glEnableVertexAttribArray((GLuint)0));
+	GL_C(glBindBuffer(GL_ARRAY_BUFFER, fullscreenVertexVbo));
+	GL_C(glVertexAttribPointer((GLuint)0, 2, GL_FLOAT, GL_FALSE, sizeof(FullscreenVertex), (void*)0));
+}
 
-	out vec2 fsUv;
+// create vertices of fullscreen quad.
+void createFullscreenQuad() {
+	std::vector<FullscreenVertex> vertices;
 
-    uniform vec2 uOffset;
-    uniform vec2 uSize;
+	vertices.push_back(FullscreenVertex{ +0.0f, +0.0f });
+	vertices.push_back(FullscreenVertex{ +1.0f, +0.0f });
+	vertices.push_back(FullscreenVertex{ +0.0f, +1.0f });
 
-	void main() {
-		fsUv = (vsPos.xy);
-		gl_Position = vec4(uSize * (vsPos.xy) + uOffset, 0.0, 1.0);
-	}
-	)",
-    
-		defines +
-		std::string(R"(
+	vertices.push_back(FullscreenVertex{ +1.0f, +0.0f });
+	vertices.push_back(FullscreenVertex{ +1.0f, +1.0f });
+	vertices.push_back(FullscreenVertex{ +0.0f, +1.0f });
 
-        uniform sampler2D ucTex;
+	// upload geometry to GPU.
+	GL_C(glGenBuffers(1, &fullscreenVertexVbo));
+	GL_C(glBindBuffer(GL_ARRAY_BUFFER, fullscreenVertexVbo));
+	GL_C(glBufferData(GL_ARRAY_BUFFER, sizeof(FullscreenVertex)*vertices.size(), (float*)vertices.data(), GL_STATIC_DRAW));
+}
 
-        out vec4 FragColor;
-        in vec2 fsUv;
+// measures how long each phase of the startup takes.
+struct StartupTimer {
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::time_point last;
+	std::string report;
 
-		void main()
-		{
-          vec3 c = texture(ucTex, vec2(fsUv.x, 1.0 - fsUv.y) ).rgb;
+	StartupTimer() {
+		start = last = std::chrono::steady_clock::now();
+	}
 
-          // take gamma into account:
-          FragColor = vec4(pow(c, vec3(2.2)), 1.0);
-		}
-		)")
-	);
-	wtcTexLocation = glGetUniformLocation(writeTexShader, "ucTex");
-	wtOffsetLocation = glGetUniformLocation(writeTexShader, "uOffset");
-	wtSizeLocation = glGetUniformLocation(writeTexShader, "uSize");
+	void phase(const char* name) {
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		char buf[128];
+		snprintf(buf, sizeof(buf), "  %-20s %8.2f ms\n", name, std::chrono::duration<double, std::milli>(now - last).count());
+		report += buf;
+		last = now;
+	}
+
+	void print() {
+		printf("startup:\n%s  %-20s %8.2f ms\n", report.c_str(), "total",
+			std::chrono::duration<double, std::milli>(last - start).count());
+	}
+};
 
-	// shader for rendering texture.
-	visShader = loadNormalShader(
-		fullscreenVs,
+void setupGraphics() {
+	StartupTimer timer;
+
+	initGlfw();
+	// nothing is known about the state of the new context.
+	invalidateGlState();
+	timer.phase("context");
+
+	// decoding and resampling the images takes a while, so do it in the background, while the rest is set up.
+	// an image is a single texture, so the images of a tiled color field are at most as large as a texture can be,
+	// and write_tex.frag scales them up the rest of the way.
+	GLint maxSize;
+	GL_C(glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize));
+	int imageWidth = std::min(dyeWidth, (int)maxSize);
+	int imageHeight = std::min(dyeHeight, (int)maxSize);
+	std::future<LinearImage> monaImage = ingestImageAsync(findAsset(monaPath), imageWidth, imageHeight, cacheDir);
+	std::future<LinearImage> screamImage = ingestImageAsync(findAsset(screamPath), imageWidth, imageHeight, cacheDir);
+
+	// all programs are submitted up front, and only checked after the textures are created.
+	// so the driver can compile them in the background, on several threads if it supports that.
+	createShaders();
+	timer.phase("shader submission");
+
+	createTextures();
+	createFullscreenQuad();
+	setDefaultGlState();
+	timer.phase("textures");
+
+	finishPrograms();
+	getUniformLocations();
+	createFrameUniformBuffer();
+	timer.phase("shader compilation");
+
+	monaTex = createImageTexture(monaImage);
+	screamTex = createImageTexture(screamImage);
+	timer.phase("images");
+
+	timer.print();
+}
 
-		std::string(R"(
+// either a single number N, or MIN:MAX.
+void parseRange(const std::string& arg, const char* value, int* minValue, int* maxValue) {
+	int n = sscanf(value, "%d:%d", minValue, maxValue);
+	if (n == 1) {
+		*maxValue = *minValue;
+	}
+	if (n < 1 || *minValue < 1 || *maxValue < *minValue) {
+		printf("%s expects a positive number N, or a range MIN:MAX\n", arg.c_str());
+		exit(1);
+	}
+}
 
-        in vec2 fsUv;
+#ifdef FLUID_BENCH
+// fluid_bench runs every stage of the simulation for a fixed number of frames in a hidden window,
+// and writes how fast the passes are as JSON. the stages never move on to the next one, and nothing waits
+// for the display, so the numbers only depend on the machine and on the sizes given on the command line.
+int benchFrames = 300;
+const int BENCH_WARMUP_FRAMES = 20;
+std::string benchJsonPath = "fluid_bench.json";
+
+const char* stageName(SimulationStage stage) {
+	switch (stage) {
+	case CIRCLE_SIM: return "circle";
+	case FADE_IN_MONA_LISA_SIM: return "fade_in_mona_lisa";
+	case MONA_LISA_SIM: return "mona_lisa";
+	case FADE_IN_THE_SCREAM_SIM: return "fade_in_the_scream";
+	case THE_SCREAM_SIM: return "the_scream";
+	case RAINBOW_SIM: return "rainbow";
+	}
+	return "unknown";
+}
 
-        uniform sampler2D uTex;
-        uniform float uBlend;
+std::string jsonString(const char* s) {
+	std::string out = "\"";
+	for (; *s != '\0'; ++s) {
+		if (*s == '"' || *s == '\\') {
+			out += '\\';
+		}
+		out += *s;
+	}
+	return out + "\"";
+}
 
-        out vec4 FragColor;
-  
-		void main()
-		{
-          FragColor = vec4(pow(clamp(texture2D(uTex, fsUv).rgb, 0.0, 1.0) * uBlend, vec3(1.0 / 2.2)), 1.0);
+// run n frames, and wait until the GPU is done with all of them, so that all the timings can be read back.
+void runBenchFrames(int n) {
+	for (int i = 0; i < n; ++i) {
+		beginProfiledFrame();
+		renderFrame();
+		endProfiledFrame();
+	}
+	collectProfiledFrames();
+}
 
+// average GPU time of all scopes with one of the given names.
+double benchPassMs(const std::vector<ScopeStats>& stats, const std::vector<std::string>& names) {
+	double ms = 0.0;
+	for (const ScopeStats& st : stats) {
+		std::string name = st.path.substr(st.path.rfind('/') + 1);
+		if (std::find(names.begin(), names.end(), name) != names.end()) {
+			ms += st.avgMs;
 		}
-		)")
-	);
-	vsTexLocation = glGetUniformLocation(visShader, "uTex");
-	vsBlendLocation = glGetUniformLocation(visShader, "uBlend");
+	}
+	return ms;
+}
 
-	// create vertices of fullscreen quad.
-	{
-		std::vector<FullscreenVertex> vertices;
+// the fraction of the tiles that are active in the last step, over all members of the ensemble. this waits for the GPU.
+double activeTileFraction() {
+	size_t active = 0;
+	size_t count = 0;
+	for (const std::vector<float>& tiles : readFloatTexture(activeTilesTex, tilesX, tilesY, 1)) {
+		active += std::count(tiles.begin(), tiles.end(), 1.0f);
+		count += tiles.size();
+	}
+	return double(active) / double(count);
+}
 
-		vertices.push_back(FullscreenVertex{ +0.0f, +0.0f });
-		vertices.push_back(FullscreenVertex{ +1.0f, +0.0f });
-		vertices.push_back(FullscreenVertex{ +0.0f, +1.0f });
+void runBenchmark() {
+	FILE* fh = fopen(benchJsonPath.c_str(), "w");
+	if (fh == nullptr) {
+		printf("Could not open %s for writing\n", benchJsonPath.c_str());
+		exit(1);
+	}
+
+	profiling = true;
+	stageLocked = true;
+
+	fprintf(fh, "{\n");
+	fprintf(fh, "  \"renderer\": %s,\n", jsonString((const char*)glGetString(GL_RENDERER)).c_str());
+	fprintf(fh, "  \"version\": %s,\n", jsonString((const char*)glGetString(GL_VERSION)).c_str());
+	fprintf(fh, "  \"grid\": [%d, %d],\n", gridWidth, gridHeight);
+	fprintf(fh, "  \"dye\": [%d, %d],\n", dyeWidth, dyeHeight);
+	fprintf(fh, "  \"dye_tiles\": [%d, %d],\n", dyeTilesX, dyeTilesY);
+	fprintf(fh, "  \"jacobiIterations\": %d,\n", quality.jacobiIterations);
+	fprintf(fh, "  \"substeps\": %d,\n", quality.substeps);
+	fprintf(fh, "  \"backend\": \"%s\",\n", backend == BACKEND_COMPUTE ? "compute" : "fragment");
+	fprintf(fh, "  \"formats\": { \"velocity\": \"%s\", \"color\": \"%s\", \"pressure\": \"%s\", \"divergence\": \"%s\" },\n",
+		fieldFormats[FIELD_VELOCITY].c_str(), fieldFormats[FIELD_COLOR].c_str(), fieldFormats[FIELD_PRESSURE].c_str(), fieldFormats[FIELD_DIVERGENCE].c_str());
+	fprintf(fh, "  \"textureMB\": %.2f,\n", totalTextureBytes() / (1024.0 * 1024.0));
+	fprintf(fh, "  \"sparseTiles\": %s,\n", sparseTiles ? "true" : "false");
+	fprintf(fh, "  \"ensemble\": %d,\n", ensembleSize);
+	fprintf(fh, "  \"frames\": %d,\n", benchFrames);
+	fprintf(fh, "  \"stages\": [\n");
+
+	// number of cells that every pass touches in a frame, in all members of the ensemble.
+	double gridCells = double(gridWidth) * gridHeight * quality.substeps * ensembleSize;
+	double dyeCells = double(dyeWidth) * dyeHeight * quality.substeps * ensembleSize;
+	struct BenchPass {
+		const char* name;
+		std::vector<std::string> scopes;
+		double cells;
+	};
+	std::vector<BenchPass> passes = {
+		{ "advection", { "color Advection", "velocity Advection" }, dyeCells + gridCells },
+		{ "emitters", { "c Add Force", "Add Color" }, gridCells + dyeCells },
+		{ "divergence", { "Compute divergence of w" }, gridCells },
+		{ "jacobi", { "Jacobi" }, gridCells * quality.jacobiIterations },
+		{ "gradientSubtraction", { "pressure gradient subtraction" }, gridCells },
+	};
+
+	// the fades in between have no emitters, so they would only measure still fluid. stageLocked keeps curSim at the
+	// stage for all of its frames.
+	const SimulationStage stages[] = { CIRCLE_SIM, MONA_LISA_SIM, THE_SCREAM_SIM, RAINBOW_SIM };
+	const int stageCount = sizeof(stages) / sizeof(stages[0]);
+	for (int i = 0; i < stageCount; ++i) {
+		// every stage starts from still fluid, and from the beginning of its emitter timeline.
+		curSim = stages[i];
+		icounter = 0;
+		clearTexture(uTex);
+		clearTexture(cTex);
+
+		runBenchFrames(BENCH_WARMUP_FRAMES);
+		passProfiler = PassProfiler(benchFrames);
+
+		long long glCallsBefore = glCalls;
+		long long glCallsSkippedBefore = glCallsSkipped;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		runBenchFrames(benchFrames);
+		double msPerFrame = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / benchFrames;
+		double glCallsPerFrame = double(glCalls - glCallsBefore) / benchFrames;
+		double glCallsSkippedPerFrame = double(glCallsSkipped - glCallsSkippedBefore) / benchFrames;
+
+		std::vector<ScopeStats> stats = passProfiler.stats();
+		printf("%-20s %8.3f ms/frame\n", stageName(stages[i]), msPerFrame);
+
+		fprintf(fh, "    {\n");
+		fprintf(fh, "      \"stage\": \"%s\",\n", stageName(stages[i]));
+		fprintf(fh, "      \"msPerFrame\": %.4f,\n", msPerFrame);
+		fprintf(fh, "      \"gpuMsPerFrame\": %.4f,\n", benchPassMs(stats, { "frame" }));
+		fprintf(fh, "      \"glCallsPerFrame\": %.1f,\n", glCallsPerFrame);
+		fprintf(fh, "      \"glCallsSkippedPerFrame\": %.1f,\n", glCallsSkippedPerFrame);
+		if (sparseTiles) {
+			fprintf(fh, "      \"activeTiles\": %.3f,\n", activeTileFraction());
+		}
+		fprintf(fh, "      \"passes\": {\n");
+		for (size_t p = 0; p < passes.size(); ++p) {
+			double ms = benchPassMs(stats, passes[p].scopes);
+			double mcells = ms > 0.0 ? passes[p].cells / (ms * 1.0e-3) / 1.0e6 : 0.0;
+			fprintf(fh, "        \"%s\": { \"ms\": %.4f, \"mcellsPerSecond\": %.2f }%s\n",
+				passes[p].name, ms, mcells, p + 1 < passes.size() ? "," : "");
+		}
+		fprintf(fh, "      }\n");
+		fprintf(fh, "    }%s\n", i + 1 < stageCount ? "," : "");
+	}
 
-		vertices.push_back(FullscreenVertex{ +1.0f, +0.0f });
-		vertices.push_back(FullscreenVertex{ +1.0f, +1.0f });
-		vertices.push_back(FullscreenVertex{ +0.0f, +1.0f });
+	fprintf(fh, "  ]\n}\n");
+	fclose(fh);
+	printf("Wrote %s\n", benchJsonPath.c_str());
+}
+#endif
 
-		// upload geometry to GPU.
-		GL_C(glGenBuffers(1, &fullscreenVertexVbo));
-		GL_C(glBindBuffer(GL_ARRAY_BUFFER, fullscreenVertexVbo));
-		GL_C(glBufferData(GL_ARRAY_BUFFER, sizeof(FullscreenVertex)*vertices.size(), (float*)vertices.data(), GL_STATIC_DRAW));
+void parseArgs(int argc, char** argv) {
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+
+		if (arg == "--dump" && i + 1 < argc) {
+			dumpPath = argv[++i];
+		}
+		else if (arg == "--dump-every" && i + 1 < argc) {
+			dumpEvery = atoi(argv[++i]);
+			if (dumpEvery < 1) {
+				dumpEvery = 1;
+			}
+		}
+		else if (arg == "--exr" && i + 1 < argc) {
+			exrPrefix = argv[++i];
+		}
+		else if (arg == "--exr-every" && i + 1 < argc) {
+			exrEvery = atoi(argv[++i]);
+			if (exrEvery < 1) {
+				exrEvery = 1;
+			}
+		}
+		else if (arg == "--grid" && i + 1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &requestedGridWidth, &requestedGridHeight) != 2) {
+				printf("--grid expects a size like 512x512\n");
+				exit(1);
+			}
+		}
+		else if (arg == "--dye" && i + 1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &requestedDyeWidth, &requestedDyeHeight) != 2) {
+				printf("--dye expects a size like 2048x2048\n");
+				exit(1);
+			}
+		}
+		else if (arg == "--dye-tile" && i + 1 < argc) {
+			dyeTileLimit = atoi(argv[++i]);
+			if (dyeTileLimit < 16) {
+				printf("--dye-tile expects a size of at least 16\n");
+				exit(1);
+			}
+		}
+		else if (arg == "--window" && i + 1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &windowWidth, &windowHeight) != 2) {
+				printf("--window expects a size like 1024x1024\n");
+				exit(1);
+			}
+		}
+		else if (arg == "--target-ms" && i + 1 < argc) {
+			targetFrameMs = atof(argv[++i]);
+		}
+		else if (arg == "--jacobi" && i + 1 < argc) {
+			parseRange(arg, argv[++i], &qualityBounds.minJacobiIterations, &qualityBounds.maxJacobiIterations);
+		}
+		else if (arg == "--substeps" && i + 1 < argc) {
+			parseRange(arg, argv[++i], &qualityBounds.minSubsteps, &qualityBounds.maxSubsteps);
+		}
+		else if (arg == "--grid-levels" && i + 1 < argc) {
+			qualityBounds.maxGridLevel = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--trace" && i + 1 < argc) {
+			tracePath = argv[++i];
+			traceAtStartup = true;
+		}
+		else if (arg == "--profile") {
+			profiling = true;
+		}
+		else if (arg == "--compare" && i + 1 < argc) {
+			comparePath = argv[++i];
+			headless = true;
+		}
+		else if (arg == "--tolerance" && i + 1 < argc) {
+			// a list like velocity=1e-4,color=1e-3
+			std::string list = argv[++i];
+			size_t begin = 0;
+			while (begin < list.size()) {
+				size_t end = list.find(',', begin);
+				if (end == std::string::npos) {
+					end = list.size();
+				}
+				std::string item = list.substr(begin, end - begin);
+				size_t eq = item.find('=');
+				if (eq == std::string::npos) {
+					printf("--tolerance expects a list like velocity=1e-4,color=1e-3\n");
+					exit(1);
+				}
+				golden.setTolerance(item.substr(0, eq), atof(item.c_str() + eq + 1));
+				begin = end + 1;
+			}
+		}
+		else if (arg == "--headless") {
+			headless = true;
+		}
+		else if (arg == "--backend" && i + 1 < argc) {
+			std::string name = argv[++i];
+			if (name == "fragment") {
+				backend = BACKEND_FRAGMENT;
+			}
+			else if (name == "compute") {
+				backend = BACKEND_COMPUTE;
+			}
+			else {
+				printf("--backend expects fragment or compute\n");
+				exit(1);
+			}
+		}
+		else if (arg == "--gl-debug") {
+			glDebug = true;
+		}
+		else if (arg == "--formats" && i + 1 < argc) {
+			if (!setFieldFormats(argv[++i])) {
+				printf("--formats expects a profile(full, half or low) and/or a list like velocity=rg16f,color=r11g11b10f\n");
+				exit(1);
+			}
+		}
+		else if (arg == "--print-graph") {
+			printStepGraph = true;
+		}
+		else if (arg == "--watch-shaders") {
+			watchShaders = true;
+		}
+		else if (arg == "--sparse-tiles") {
+			sparseTiles = true;
+		}
+		else if (arg == "--sparse-threshold" && i + 1 < argc) {
+			sparseTiles = true;
+			sparseThreshold = (float)atof(argv[++i]);
+		}
+		else if (arg == "--ensemble" && i + 1 < argc) {
+			ensembleSize = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--ensemble-force" && i + 1 < argc) {
+			ensembleForce = (float)atof(argv[++i]);
+		}
+		else if (arg == "--metrics" && i + 1 < argc) {
+			metricsPath = argv[++i];
+		}
+		else if (arg == "--metrics-every" && i + 1 < argc) {
+			metricsEvery = std::max(1, atoi(argv[++i]));
+		}
+#ifdef FLUID_BENCH
+		else if (arg == "--frames" && i + 1 < argc) {
+			benchFrames = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--json" && i + 1 < argc) {
+			benchJsonPath = argv[++i];
+		}
+#endif
+		else if (arg == "--mona" && i + 1 < argc) {
+			monaPath = argv[++i];
+		}
+		else if (arg == "--scream" && i + 1 < argc) {
+			screamPath = argv[++i];
+		}
+		else if (arg == "--cache-dir" && i + 1 < argc) {
+			cacheDir = argv[++i];
+		}
+		else if (arg == "--no-cache") {
+			cacheDir = "";
+		}
+		else {
+			printf("Unknown argument %s\n\n", arg.c_str());
+			printf("Usage: %s [--dump FILE] [--dump-every N] [--exr PREFIX] [--exr-every N]\n"
+				"    [--grid WxH] [--dye WxH] [--dye-tile N] [--window WxH] [--mona IMAGE] [--scream IMAGE] [--cache-dir DIR] [--no-cache]\n"
+				"    [--target-ms MS] [--jacobi N|MIN:MAX] [--substeps N|MIN:MAX] [--grid-levels N] [--profile] [--trace FILE]\n"
+				"    [--compare REFERENCE] [--tolerance FIELD=MAXABS,...] [--headless] [--metrics FILE] [--metrics-every N]\n"
+				"    [--gl-debug] [--print-graph] [--formats PROFILE,FIELD=FORMAT,...] [--backend fragment|compute]\n"
+				"    [--watch-shaders] [--sparse-tiles] [--sparse-threshold VALUE] [--ensemble N] [--ensemble-force SCALE]\n", argv[0]);
+#ifdef FLUID_BENCH
+			printf("    [--frames N] [--json FILE]\n");
+#endif
+			exit(1);
+		}
 	}
+
+	// the simulation starts out with the default quality, and the governor may lower it from there.
+	quality.jacobiIterations = qualityBounds.maxJacobiIterations;
+	quality.substeps = qualityBounds.minSubsteps;
 }
 
+#ifdef FLUID_BENCH
+int main(int argc, char** argv) {
+	parseArgs(argc, argv);
+	// the benchmark never presents anything.
+	headless = true;
+
+	setupGraphics();
+	if (!initProfiler()) {
+		printf("Timer queries are not supported, so nothing can be measured\n");
+		exit(1);
+	}
+	runBenchmark();
+
+	glfwTerminate();
+	exit(EXIT_SUCCESS);
+}
+#else
 int main(int argc, char** argv) {
+	parseArgs(argc, argv);
+	traceThreadName("main");
+
 	setupGraphics();
 
+	if (dumpPath != "") {
+		openFieldDump();
+	}
+	if (exrPrefix != "") {
+		exrExporter.start(std::max(1, (int)std::thread::hardware_concurrency()));
+	}
+	if (comparePath != "" && !golden.open(comparePath)) {
+		exit(1);
+	}
+	if (targetFrameMs > 0.0) {
+		startGovernor();
+	}
+	if (!initProfiler()) {
+		pglQueryCounter = nullptr;
+		if (profiling) {
+			printf("Timer queries are not supported, so the passes can not be profiled\n");
+			profiling = false;
+		}
+	}
+	if (traceAtStartup) {
+		startTrace();
+	}
+	if (watchShaders) {
+		watchShaderFiles();
+		shaderWatcher.start(250);
+	}
+
 	float frameStartTime = 0;
 	float frameEndTime = 0;
 	frameStartTime = (float)glfwGetTime();
 	
 	while (!glfwWindowShouldClose(window) && !done) {
-		glfwPollEvents();
+		{
+			TraceScope trace("glfwPollEvents");
+			glfwPollEvents();
+		}
 		handleInput();
-		renderFrame();
+		if (shaderWatcher.isRunning()) {
+			TraceScope trace("reloadShaders");
+			reloadShaders();
+		}
+		if (governor.isRunning()) {
+			updateGovernor();
+		}
+
+		bool timed = governor.isRunning() && beginFrameTimer();
+		beginProfiledFrame();
+		{
+			TraceScope trace("renderFrame");
+			renderFrame();
+		}
+		endProfiledFrame();
+		if (timed) {
+			endFrameTimer();
+		}
 
-		glfwSwapBuffers(window);
+		{
+			TraceScope trace("glfwSwapBuffers");
+			glfwSwapBuffers(window);
+		}
+
+		// a comparison is over once the last frame of the reference was compared.
+		if (golden.isOpen() && frameCount > golden.getFrames().back()) {
+			done = true;
+		}
 		
 		// FPS regulation code. we will ensure that a framerate of 30FPS is maintained.
 		// and for simplicity, we just assume that the computer is always able to maintain a framerate of at least 30FPS.
-		{
+		if (!headless) {
 			frameEndTime = (float)glfwGetTime();
 			float frameDuration = frameEndTime - frameStartTime;
 			const float sleepDuration = 1.0f / 30.0f - frameDuration;
 			if (sleepDuration > 0.0f) {
+				TraceScope trace("sleep");
 				std::this_thread::sleep_for(std::chrono::milliseconds((int)(sleepDuration  * 1000.0f)));
 			}
 			frameStartTime = (float)glfwGetTime();
 		}
 	}
 
+	fieldDump.close();
+	exrExporter.stop();
+	if (metricsPath != "") {
+		// publish the last diagnostics too.
+		GL_C(glFinish());
+		collectDiagnostics();
+	}
+	if (profiling) {
+		passProfiler.print();
+		printGlCallCounts();
+	}
+	if (traceEnabled()) {
+		stopTrace();
+	}
+	shaderWatcher.stop();
+	glDebugLog.stop();
+
+	bool pass = !golden.isOpen() || golden.printSummary();
+
 	glfwTerminate();
-	exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+	exit(pass ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+#endif
@@ -0,0 +1,105 @@
+#include "pass_profiler.h"
+
+#include <cstdio>
+#include <algorithm>
+
+PassProfiler::PassProfiler(int window_) : window(window_), nFrames(0) {
+}
+
+int PassProfiler::findNode(int parent, const char* name) {
+	const std::vector<int>& siblings = parent == -1 ? roots : nodes[parent].children;
+	for (int i : siblings) {
+		if (nodes[i].name == name) {
+			return i;
+		}
+	}
+
+	Node n;
+	n.name = name;
+	n.parent = parent;
+	n.samples.resize(window);
+	n.nSamples = 0;
+	n.frameMs = 0.0;
+	n.seen = false;
+	nodes.push_back(n);
+
+	int index = (int)nodes.size() - 1;
+	if (parent == -1) {
+		roots.push_back(index);
+	}
+	else {
+		nodes[parent].children.push_back(index);
+	}
+	return index;
+}
+
+void PassProfiler::addFrame(const std::vector<ScopeTiming>& scopes) {
+	// map the scopes of the frame to nodes. parents always come before their children.
+	std::vector<int> nodeOf(scopes.size());
+	for (size_t i = 0; i < scopes.size(); ++i) {
+		int parent = scopes[i].parent == -1 ? -1 : nodeOf[scopes[i].parent];
+		int n = findNode(parent, scopes[i].name);
+		nodeOf[i] = n;
+		if (!nodes[n].seen) {
+			nodes[n].seen = true;
+			nodes[n].frameMs = 0.0;
+		}
+		nodes[n].frameMs += scopes[i].ms;
+	}
+
+	for (Node& n : nodes) {
+		if (n.seen) {
+			n.samples[n.nSamples % window] = n.frameMs;
+			n.nSamples++;
+			n.seen = false;
+		}
+	}
+	nFrames++;
+}
+
+void PassProfiler::addStats(int node, const std::string& parentPath, int depth, std::vector<ScopeStats>& out) const {
+	const Node& n = nodes[node];
+	int count = std::min(n.nSamples, window);
+	std::vector<double> s(n.samples.begin(), n.samples.begin() + count);
+	std::sort(s.begin(), s.end());
+
+	double sum = 0.0;
+	for (double ms : s) {
+		sum += ms;
+	}
+
+	ScopeStats st;
+	st.path = parentPath == "" ? n.name : parentPath + "/" + n.name;
+	st.depth = depth;
+	st.minMs = s.front();
+	st.avgMs = sum / count;
+	st.p99Ms = s[std::min(s.size() - 1, (size_t)(0.99 * s.size()))];
+	st.frames = count;
+	out.push_back(st);
+
+	for (int child : n.children) {
+		addStats(child, st.path, depth + 1, out);
+	}
+}
+
+std::vector<ScopeStats> PassProfiler::stats() const {
+	std::vector<ScopeStats> out;
+	for (int root : roots) {
+		addStats(root, "", 0, out);
+	}
+	return out;
+}
+
+void PassProfiler::print() const {
+	if (nFrames == 0) {
+		printf("No GPU timings were collected yet\n");
+		return;
+	}
+	printf("GPU time of the passes, in ms, over the last %d frames:\n", std::min(nFrames, window));
+	printf("  %-40s %8s %8s %8s %8s\n", "pass", "min", "avg", "p99", "frames");
+	for (const ScopeStats& st : stats()) {
+		char label[64];
+		snprintf(label, sizeof(label), "%*s%s", 2 * st.depth, "", st.path.substr(st.path.rfind('/') + 1).c_str());
+		printf("  %-40s %8.3f %8.3f %8.3f %8d\n", label, st.minMs, st.avgMs, st.p99Ms, st.frames);
+	}
+}
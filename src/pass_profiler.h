@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// rolling statistics of the GPU time of the passes, as measured by the dpush()/dpop() scopes in main.cpp.
+//
+// the scopes of a frame form a tree. a scope is identified by its path in the tree, so the same pass
+// under different parents is kept apart, and a pass that runs several times in a frame(for instance once
+// per substep) is summed up into a single sample for that frame. for every scope the samples of the last
+// few hundred frames are kept, and the minimum, average and 99th percentile of those are printed.
+
+struct ScopeTiming {
+	const char* name;
+	int parent; // index of the parent scope in the same frame, or -1.
+	double ms;
+};
+
+struct ScopeStats {
+	std::string path; // names of the scopes from the root down, separated by '/'.
+	int depth;
+	double minMs;
+	double avgMs;
+	double p99Ms;
+	int frames;
+};
+
+class PassProfiler {
+public:
+	// window is the number of frames that are kept per scope.
+	explicit PassProfiler(int window = 256);
+
+	void addFrame(const std::vector<ScopeTiming>& scopes);
+
+	// all scopes, with every parent before its children.
+	std::vector<ScopeStats> stats() const;
+	void print() const;
+
+private:
+	struct Node {
+		std::string name;
+		int parent;
+		std::vector<int> children;
+		std::vector<double> samples; // ring buffer of window samples.
+		int nSamples;
+		double frameMs; // sum over the frame that is currently added.
+		bool seen;      // whether the current frame contains this scope.
+	};
+
+	int findNode(int parent, const char* name);
+	void addStats(int node, const std::string& parentPath, int depth, std::vector<ScopeStats>& out) const;
+
+	int window;
+	std::vector<Node> nodes;
+	std::vector<int> roots;
+	int nFrames;
+};
@@ -0,0 +1,128 @@
+#include "quality_governor.h"
+
+#include <cstdio>
+#include <math.h>
+#include <algorithm>
+
+namespace {
+
+// number of frames that are averaged, before a decision is made.
+const int WINDOW_FRAMES = 20;
+// frames that are ignored after a change. the timer results lag a few frames behind,
+// and resizing the grid makes a single slow frame.
+const int COOLDOWN_FRAMES = 10;
+
+// quality is degraded above DEGRADE_ABOVE * target, and improved below IMPROVE_BELOW * target.
+const double DEGRADE_ABOVE = 1.05;
+const double IMPROVE_BELOW = 0.75;
+// an improvement is only made if the predicted frame time stays below this.
+const double PREDICTED_LIMIT = 0.9;
+
+const int JACOBI_STEP = 10;
+
+// rough cost of all the passes except for the jacobi iterations, measured in jacobi iterations.
+const double OTHER_PASSES = 8.0;
+
+} // namespace
+
+int gridSizeAtLevel(int size, int level) {
+	return std::max(16, (int)floor(size * pow(2.0, -level / 2.0) + 0.5));
+}
+
+QualityGovernor::QualityGovernor() : running(false), targetMs(0.0), sumMs(0.0), nSamples(0), cooldown(0) {
+	bounds = QualityBounds{ 0, 0, 0, 0, 0 };
+}
+
+void QualityGovernor::start(double targetMs_, const QualityBounds& bounds_) {
+	running = true;
+	targetMs = targetMs_;
+	bounds = bounds_;
+	sumMs = 0.0;
+	nSamples = 0;
+	cooldown = 0;
+	printf("governor: target %.2f ms, jacobi iterations %d-%d, substeps %d-%d, grid levels 0-%d\n",
+		targetMs, bounds.minJacobiIterations, bounds.maxJacobiIterations, bounds.minSubsteps, bounds.maxSubsteps, bounds.maxGridLevel);
+}
+
+bool QualityGovernor::update(double gpuMs, QualitySettings& settings) {
+	if (!running) {
+		return false;
+	}
+	if (cooldown > 0) {
+		--cooldown;
+		return false;
+	}
+
+	sumMs += gpuMs;
+	if (++nSamples < WINDOW_FRAMES) {
+		return false;
+	}
+	double avgMs = sumMs / nSamples;
+	sumMs = 0.0;
+	nSamples = 0;
+
+	bool changed = false;
+	if (avgMs > targetMs * DEGRADE_ABOVE) {
+		changed = degrade(avgMs, settings);
+		if (!changed) {
+			printf("governor: %.2f ms, over the target of %.2f ms, but already at the lowest quality\n", avgMs, targetMs);
+		}
+	}
+	else if (avgMs < targetMs * IMPROVE_BELOW) {
+		changed = improve(avgMs, settings);
+	}
+
+	if (changed) {
+		cooldown = COOLDOWN_FRAMES;
+	}
+	return changed;
+}
+
+bool QualityGovernor::degrade(double avgMs, QualitySettings& s) {
+	if (s.jacobiIterations > bounds.minJacobiIterations) {
+		int to = std::max(bounds.minJacobiIterations, s.jacobiIterations - JACOBI_STEP);
+		log(avgMs, "jacobi iterations", s.jacobiIterations, to);
+		s.jacobiIterations = to;
+		return true;
+	}
+	if (s.substeps > bounds.minSubsteps) {
+		log(avgMs, "substeps", s.substeps, s.substeps - 1);
+		s.substeps--;
+		return true;
+	}
+	if (s.gridLevel < bounds.maxGridLevel) {
+		log(avgMs, "grid level", s.gridLevel, s.gridLevel + 1);
+		s.gridLevel++;
+		return true;
+	}
+	return false;
+}
+
+bool QualityGovernor::improve(double avgMs, QualitySettings& s) {
+	double limit = targetMs * PREDICTED_LIMIT;
+
+	if (s.gridLevel > 0 && avgMs * 2.0 < limit) {
+		log(avgMs, "grid level", s.gridLevel, s.gridLevel - 1);
+		s.gridLevel--;
+		return true;
+	}
+	if (s.substeps < bounds.maxSubsteps && avgMs * (s.substeps + 1) / s.substeps < limit) {
+		log(avgMs, "substeps", s.substeps, s.substeps + 1);
+		s.substeps++;
+		return true;
+	}
+	if (s.jacobiIterations < bounds.maxJacobiIterations) {
+		int to = std::min(bounds.maxJacobiIterations, s.jacobiIterations + JACOBI_STEP);
+		double cost = (to + OTHER_PASSES) / (s.jacobiIterations + OTHER_PASSES);
+		if (avgMs * cost < limit) {
+			log(avgMs, "jacobi iterations", s.jacobiIterations, to);
+			s.jacobiIterations = to;
+			return true;
+		}
+	}
+	return false;
+}
+
+void QualityGovernor::log(double avgMs, const char* what, int from, int to) {
+	printf("governor: %.2f ms, target %.2f ms: %s %d -> %d\n", avgMs, targetMs, what, from, to);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// keeps the GPU time of a frame close to a target, by trading simulation quality for speed.
+//
+// there are three knobs, which are turned in this order when the frames are too slow:
+//   the number of jacobi iterations of the pressure solve(cheapest in terms of quality),
+//   the number of simulation substeps per frame,
+//   and the resolution of the simulation grid(most expensive, since resizing resamples the velocity).
+// when there is plenty of headroom, they are turned back in the opposite order.
+//
+// to prevent oscillation, the governor only acts on the average of a window of frames, it has separate
+// thresholds for degrading and for improving quality, it waits a while after every change, and it does not
+// make a change that it predicts would immediately put the frame time over the target again.
+// every decision is printed, so quality drops can be traced back afterwards.
+
+struct QualitySettings {
+	int jacobiIterations;
+	int substeps;
+	// the grid is scaled by 2^(-gridLevel / 2), so every level halves or doubles the number of cells.
+	int gridLevel;
+};
+
+struct QualityBounds {
+	int minJacobiIterations;
+	int maxJacobiIterations;
+	int minSubsteps;
+	int maxSubsteps;
+	int maxGridLevel; // level 0 is the grid that the simulation was started with.
+};
+
+// width or height of the grid at some level.
+int gridSizeAtLevel(int size, int level);
+
+class QualityGovernor {
+public:
+	QualityGovernor();
+
+	void start(double targetMs, const QualityBounds& bounds);
+	bool isRunning() const { return running; }
+
+	// feed the GPU time of a frame. returns true if settings was changed.
+	bool update(double gpuMs, QualitySettings& settings);
+
+private:
+	bool degrade(double avgMs, QualitySettings& settings);
+	bool improve(double avgMs, QualitySettings& settings);
+	void log(double avgMs, const char* what, int from, int to);
+
+	bool running;
+	double targetMs;
+	QualityBounds bounds;
+
+	double sumMs;
+	int nSamples;
+	int cooldown;
+};
@@ -0,0 +1,125 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <cstdio>
+
+int RenderGraph::addTexture(const std::string& name, int formatClass, bool persistent, bool exported) {
+	textures.push_back(GraphTexture{ name, formatClass, persistent, exported });
+	return (int)textures.size() - 1;
+}
+
+int RenderGraph::addPass(const std::string& name, const std::vector<int>& reads, const std::vector<int>& writes) {
+	passes.push_back(GraphPass{ name, reads, writes });
+	return (int)passes.size() - 1;
+}
+
+// the range of passes that a texture is live in. persistent textures are live from before the first pass,
+// and persistent and exported textures until after the last one. a texture that no pass uses gets first > last.
+void RenderGraph::lifetime(int texture, int* first, int* last) const {
+	const GraphTexture& t = textures[texture];
+	int n = (int)passes.size();
+	*first = t.persistent ? -1 : n;
+	*last = (t.persistent || t.exported) ? n : -1;
+	for (int p = 0; p < n; ++p) {
+		const GraphPass& pass = passes[p];
+		bool used = std::find(pass.reads.begin(), pass.reads.end(), texture) != pass.reads.end() ||
+			std::find(pass.writes.begin(), pass.writes.end(), texture) != pass.writes.end();
+		if (used) {
+			*first = std::min(*first, p);
+			*last = std::max(*last, p);
+		}
+	}
+}
+
+CompiledGraph RenderGraph::compile() const {
+	CompiledGraph c;
+	int nTextures = (int)textures.size();
+	c.physical.assign(nTextures, -1);
+	c.clears.resize(passes.size());
+	c.invalidates.resize(passes.size());
+
+	std::vector<int> first(nTextures);
+	std::vector<int> last(nTextures);
+	for (int t = 0; t < nTextures; ++t) {
+		lifetime(t, &first[t], &last[t]);
+	}
+
+	// hand out the physical textures in the order that the textures become live. a physical texture is free again
+	// once the last texture that was given it has died. this is the usual greedy interval allocation,
+	// which is optimal when every texture has a single interval.
+	std::vector<int> order;
+	for (int t = 0; t < nTextures; ++t) {
+		if (first[t] <= last[t]) {
+			order.push_back(t);
+		}
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return first[a] < first[b]; });
+
+	std::vector<int> physicalEnd;       // the last pass that the current owner of a physical texture is live in.
+	std::vector<bool> physicalShared;   // persistent textures keep theirs to themselves.
+	for (int t : order) {
+		int chosen = -1;
+		if (!textures[t].persistent) {
+			for (size_t p = 0; p < physicalEnd.size(); ++p) {
+				if (physicalShared[p] && c.physicalFormat[p] == textures[t].formatClass && physicalEnd[p] < first[t]) {
+					chosen = (int)p;
+					break;
+				}
+			}
+		}
+		if (chosen == -1) {
+			chosen = (int)physicalEnd.size();
+			physicalEnd.push_back(0);
+			physicalShared.push_back(!textures[t].persistent);
+			c.physicalFormat.push_back(textures[t].formatClass);
+		}
+		physicalEnd[chosen] = last[t];
+		c.physical[t] = chosen;
+	}
+
+	// a transient texture whose first pass reads it expects it to be zero. all other clears are unnecessary.
+	for (int t = 0; t < nTextures; ++t) {
+		if (textures[t].persistent || first[t] > last[t]) {
+			continue;
+		}
+		const GraphPass& pass = passes[first[t]];
+		if (std::find(pass.reads.begin(), pass.reads.end(), t) != pass.reads.end()) {
+			c.clears[first[t]].push_back(t);
+		}
+	}
+
+	// everything else that a pass writes, and does not read, is garbage before the pass.
+	for (size_t p = 0; p < passes.size(); ++p) {
+		const GraphPass& pass = passes[p];
+		for (int t : pass.writes) {
+			bool read = std::find(pass.reads.begin(), pass.reads.end(), t) != pass.reads.end();
+			bool cleared = std::find(c.clears[p].begin(), c.clears[p].end(), t) != c.clears[p].end();
+			if (!read && !cleared) {
+				c.invalidates[p].push_back(t);
+			}
+		}
+	}
+
+	return c;
+}
+
+void RenderGraph::print(const CompiledGraph& c) const {
+	printf("render graph, %d passes, %d textures in %d physical textures:\n", (int)passes.size(), (int)textures.size(), (int)c.physicalFormat.size());
+	for (size_t t = 0; t < textures.size(); ++t) {
+		int first, last;
+		lifetime((int)t, &first, &last);
+		if (first > last) {
+			printf("  %-20s unused\n", textures[t].name.c_str());
+			continue;
+		}
+		char range[64];
+		snprintf(range, sizeof(range), "%s to %s",
+			first < 0 ? "(start)" : passes[first].name.c_str(), last >= (int)passes.size() ? "(end)" : passes[last].name.c_str());
+		printf("  %-20s physical %2d, live from %s\n", textures[t].name.c_str(), c.physical[t], range);
+	}
+	for (size_t p = 0; p < passes.size(); ++p) {
+		for (int t : c.clears[p]) {
+			printf("  %s is cleared before %s\n", textures[t].name.c_str(), passes[p].name.c_str());
+		}
+	}
+}
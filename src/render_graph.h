@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// a simulation step, declared as a list of passes with the textures that every pass reads and writes.
+//
+// compile() works out the lifetime of every texture, from the first pass that touches it to the last one,
+// and lets transient textures whose lifetimes do not overlap share the same memory(the same physical texture).
+// it also finds the transient textures that are read before they are written, which are the only ones that have to
+// be cleared. every pass renders a fullscreen quad, so a texture that a pass writes is overwritten completely,
+// and clearing it first would be a waste of bandwidth. instead, the old contents of a texture that a pass writes
+// without reading it are invalidated, so that the driver does not have to keep them around.
+//
+// persistent textures keep their contents from one execution to the next, and never share memory.
+// exported textures are read by someone else after the graph ran, so they stay live until the end of the graph,
+// but they may share memory with textures that are only live before them.
+
+struct GraphTexture {
+	std::string name;
+	int formatClass; // only textures of the same format class(format and size) can share memory.
+	bool persistent;
+	bool exported;
+};
+
+struct GraphPass {
+	std::string name;
+	std::vector<int> reads;
+	std::vector<int> writes;
+};
+
+struct CompiledGraph {
+	std::vector<int> physical;        // for every texture, the index of its physical texture.
+	std::vector<int> physicalFormat;  // the format class of every physical texture.
+	std::vector<std::vector<int> > clears; // for every pass, the textures that must be cleared before it runs.
+	std::vector<std::vector<int> > invalidates; // for every pass, the textures whose contents it does not need.
+};
+
+class RenderGraph {
+public:
+	int addTexture(const std::string& name, int formatClass, bool persistent, bool exported);
+	int addPass(const std::string& name, const std::vector<int>& reads, const std::vector<int>& writes);
+
+	const std::vector<GraphTexture>& getTextures() const { return textures; }
+	const std::vector<GraphPass>& getPasses() const { return passes; }
+
+	CompiledGraph compile() const;
+
+	// prints the passes, the lifetimes and which textures share memory.
+	void print(const CompiledGraph& compiled) const;
+
+private:
+	void lifetime(int texture, int* first, int* last) const;
+
+	std::vector<GraphTexture> textures;
+	std::vector<GraphPass> passes;
+};
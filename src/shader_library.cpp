@@ -0,0 +1,166 @@
+#include "shader_library.h"
+
+#include <chrono>
+#include <cstdio>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "trace_recorder.h"
+
+static bool readText(const std::string& path, std::string* text) {
+	FILE* fh = fopen(path.c_str(), "rb");
+	if (fh == nullptr) {
+		return false;
+	}
+	char buf[4096];
+	size_t n;
+	text->clear();
+	while ((n = fread(buf, 1, sizeof(buf), fh)) > 0) {
+		text->append(buf, n);
+	}
+	fclose(fh);
+	return true;
+}
+
+// the file name of an #include "file" line, or an empty string if the line is something else.
+static std::string includedFile(const std::string& line) {
+	size_t i = line.find_first_not_of(" \t");
+	if (i == std::string::npos || line.compare(i, 8, "#include") != 0) {
+		return "";
+	}
+	size_t begin = line.find('"', i + 8);
+	size_t end = begin == std::string::npos ? std::string::npos : line.find('"', begin + 1);
+	if (end == std::string::npos) {
+		return "";
+	}
+	return line.substr(begin + 1, end - begin - 1);
+}
+
+static bool expand(const std::string& dir, const std::string& name, const std::string& includer, ShaderSource* source, std::string* error) {
+	std::string path = dir + "/" + name;
+	for (const std::string& f : source->files) {
+		if (f == path) {
+			return true;
+		}
+	}
+
+	std::string text;
+	if (!readText(path, &text)) {
+		*error = "could not open " + path + (includer == "" ? "" : ", which is included from " + includer);
+		return false;
+	}
+	int number = (int)source->files.size();
+	source->files.push_back(path);
+
+	source->text += "#line 1 " + std::to_string(number) + "\n";
+	size_t pos = 0;
+	int line = 1;
+	while (pos < text.size()) {
+		size_t end = text.find('\n', pos);
+		if (end == std::string::npos) {
+			end = text.size();
+		}
+		std::string s = text.substr(pos, end - pos);
+		std::string include = includedFile(s);
+		if (include != "") {
+			if (!expand(dir, include, path, source, error)) {
+				return false;
+			}
+			source->text += "#line " + std::to_string(line + 1) + " " + std::to_string(number) + "\n";
+		}
+		else {
+			source->text += s + "\n";
+		}
+		pos = end + 1;
+		++line;
+	}
+	return true;
+}
+
+bool loadShaderSource(const std::string& dir, const std::string& name, ShaderSource* source, std::string* error) {
+	source->text.clear();
+	source->files.clear();
+	return expand(dir, name, "", source, error);
+}
+
+// -1 if the file does not exist. two saves within the same second are told apart by the nanoseconds where we have them.
+static long long modificationTime(const std::string& path) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		return -1;
+	}
+#if defined(__linux__)
+	return (long long)st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+	return (long long)st.st_mtimespec.tv_sec * 1000000000ll + st.st_mtimespec.tv_nsec;
+#else
+	return (long long)st.st_mtime * 1000000000ll;
+#endif
+}
+
+FileWatcher::FileWatcher() : stopping(false), intervalMs(250) {
+}
+
+FileWatcher::~FileWatcher() {
+	stop();
+}
+
+void FileWatcher::start(int interval) {
+	intervalMs = interval;
+	stopping = false;
+	worker = std::thread(&FileWatcher::workerLoop, this);
+}
+
+void FileWatcher::stop() {
+	if (!worker.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		cv.notify_all();
+	}
+	worker.join();
+}
+
+void FileWatcher::watch(const std::vector<std::string>& paths) {
+	std::map<std::string, long long> times;
+	for (const std::string& path : paths) {
+		times[path] = -1;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& t : times) {
+		auto old = mtimes.find(t.first);
+		t.second = old != mtimes.end() ? old->second : modificationTime(t.first);
+	}
+	mtimes.swap(times);
+}
+
+std::vector<std::string> FileWatcher::takeChanged() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<std::string> result(changed.begin(), changed.end());
+	changed.clear();
+	return result;
+}
+
+void FileWatcher::workerLoop() {
+	traceThreadName("file watcher");
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		cv.wait_for(lock, std::chrono::milliseconds(intervalMs), [this] { return stopping; });
+		if (stopping) {
+			return;
+		}
+		// stat() is quick, and there are only a few dozen files, so this holds the lock while it polls.
+		for (auto& t : mtimes) {
+			long long time = modificationTime(t.first);
+			if (time != -1 && time != t.second) {
+				changed.insert(t.first);
+			}
+			if (time != -1) {
+				t.second = time;
+			}
+		}
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// the shaders are loaded from files, see shaders/, which can include other files with #include "file".
+// every file is only included once per shader, like with #pragma once, so the shared files can include
+// what they need themselves.
+//
+// the included files are pasted in with #line directives around them, which give every file its own source string number.
+// the compiler prints that number in front of the line numbers of its errors, and files[number] is the file it means.
+
+struct ShaderSource {
+	std::string text;
+	std::vector<std::string> files; // the paths of the shader and of every file it includes, in the order they were included.
+};
+
+// loads dir/name, and expands its includes, which are relative to dir. returns false, and a message in error,
+// if a file can not be read.
+bool loadShaderSource(const std::string& dir, const std::string& name, ShaderSource* source, std::string* error);
+
+// polls the modification times of a set of files in a background thread, so that the shaders can be reloaded
+// when they are saved. files that disappear are ignored until they are back, since editors like to save
+// by deleting the old file and renaming a new one over it.
+class FileWatcher {
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	void start(int intervalMs);
+	void stop();
+	bool isRunning() const { return worker.joinable(); }
+
+	// replaces the set of watched files. the files that were watched already keep their modification times,
+	// so that nothing is lost when this is called after a change.
+	void watch(const std::vector<std::string>& paths);
+
+	// the files that changed since the last call.
+	std::vector<std::string> takeChanged();
+
+private:
+	void workerLoop();
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool stopping;
+	int intervalMs;
+
+	// the last seen modification time of every watched file, -1 if it did not exist.
+	std::map<std::string, long long> mtimes;
+	std::set<std::string> changed;
+};
@@ -0,0 +1,209 @@
+#include "trace_recorder.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+	const char* name;
+	int64_t begin;
+	int64_t end;
+};
+
+// events are stored in a linked list of chunks, so appending never moves events that a reader might be looking at.
+const size_t CHUNK_EVENTS = 4096;
+
+struct Chunk {
+	TraceEvent events[CHUNK_EVENTS];
+	std::atomic<Chunk*> next;
+
+	Chunk() : next(nullptr) {
+	}
+};
+
+struct ThreadBuffer {
+	int tid;
+	std::atomic<const char*> name;
+	bool inUse; // guarded by registryMutex.
+
+	// only touched by the thread that owns the buffer.
+	Chunk* tail;
+
+	Chunk* head;
+	// the session that count belongs to. the owner resets the buffer when it sees a new session.
+	std::atomic<int> session;
+	std::atomic<size_t> count;
+
+	explicit ThreadBuffer(int tid_) : tid(tid_), name(nullptr), inUse(false), session(-1), count(0) {
+		head = tail = new Chunk();
+	}
+};
+
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+std::atomic<bool> enabled(false);
+std::atomic<int> session(0);
+
+std::mutex registryMutex;
+std::vector<ThreadBuffer*> buffers; // never freed, they are handed on instead.
+int nextTid = 1;
+
+ThreadBuffer gpuBuffer(0);
+
+ThreadBuffer* acquireBuffer() {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (ThreadBuffer* b : buffers) {
+		if (!b->inUse) {
+			b->inUse = true;
+			return b;
+		}
+	}
+	ThreadBuffer* b = new ThreadBuffer(nextTid++);
+	b->inUse = true;
+	buffers.push_back(b);
+	return b;
+}
+
+// gives the buffer of a thread back when the thread exits.
+struct BufferHolder {
+	ThreadBuffer* buffer = nullptr;
+
+	ThreadBuffer* get() {
+		if (buffer == nullptr) {
+			buffer = acquireBuffer();
+		}
+		return buffer;
+	}
+
+	~BufferHolder() {
+		if (buffer != nullptr) {
+			std::lock_guard<std::mutex> lock(registryMutex);
+			buffer->inUse = false;
+		}
+	}
+};
+
+thread_local BufferHolder holder;
+
+void append(ThreadBuffer* b, const TraceEvent& e) {
+	int s = session.load(std::memory_order_acquire);
+	size_t n = b->count.load(std::memory_order_relaxed);
+	if (b->session.load(std::memory_order_relaxed) != s) {
+		n = 0;
+		b->tail = b->head;
+		b->count.store(0, std::memory_order_relaxed);
+		b->session.store(s, std::memory_order_release);
+	}
+
+	if (n > 0 && n % CHUNK_EVENTS == 0) {
+		Chunk* next = b->tail->next.load(std::memory_order_acquire);
+		if (next == nullptr) {
+			next = new Chunk();
+			b->tail->next.store(next, std::memory_order_release);
+		}
+		b->tail = next;
+	}
+	b->tail->events[n % CHUNK_EVENTS] = e;
+	b->count.store(n + 1, std::memory_order_release);
+}
+
+void writeEvents(FILE* fh, int pid, const ThreadBuffer& b, int s) {
+	if (b.session.load(std::memory_order_acquire) != s) {
+		return;
+	}
+	size_t n = b.count.load(std::memory_order_acquire);
+	if (n == 0) {
+		return;
+	}
+
+	const char* name = b.name.load();
+	char fallback[32];
+	if (name == nullptr) {
+		snprintf(fallback, sizeof(fallback), "thread %d", b.tid);
+		name = fallback;
+	}
+	fprintf(fh, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", pid, b.tid, name);
+
+	const Chunk* chunk = b.head;
+	for (size_t i = 0; i < n; ++i) {
+		if (i > 0 && i % CHUNK_EVENTS == 0) {
+			chunk = chunk->next.load(std::memory_order_acquire);
+		}
+		const TraceEvent& e = chunk->events[i % CHUNK_EVENTS];
+		// the timestamps of the format are in microseconds.
+		fprintf(fh, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			e.name, pid, b.tid, double(e.begin) / 1000.0, double(e.end - e.begin) / 1000.0);
+	}
+}
+
+} // namespace
+
+int64_t traceNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void traceStart() {
+	session.fetch_add(1);
+	enabled = true;
+}
+
+bool traceStop(const std::string& path) {
+	if (!enabled) {
+		return false;
+	}
+	enabled = false;
+	int s = session.load();
+
+	FILE* fh = fopen(path.c_str(), "w");
+	if (fh == nullptr) {
+		printf("Could not open %s for writing\n", path.c_str());
+		return false;
+	}
+
+	// the CPU threads are process 1, and the GPU is process 2, so the two show up as separate groups.
+	fprintf(fh, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	fprintf(fh, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}}");
+	fprintf(fh, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"GPU\"}}");
+
+	std::vector<ThreadBuffer*> snapshot;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		snapshot = buffers;
+	}
+	for (ThreadBuffer* b : snapshot) {
+		writeEvents(fh, 1, *b, s);
+	}
+	writeEvents(fh, 2, gpuBuffer, s);
+
+	fprintf(fh, "\n]}\n");
+	fclose(fh);
+	printf("Wrote trace to %s\n", path.c_str());
+	return true;
+}
+
+bool traceEnabled() {
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void traceThreadName(const char* name) {
+	holder.get()->name = name;
+}
+
+void traceSpan(const char* name, int64_t beginNs, int64_t endNs) {
+	append(holder.get(), TraceEvent{ name, beginNs, endNs });
+}
+
+void traceGpuSpan(const char* name, int64_t beginNs, int64_t endNs) {
+	// the GPU spans are read back later than they are recorded, and may arrive after the trace was stopped.
+	if (!traceEnabled()) {
+		return;
+	}
+	if (gpuBuffer.name.load() == nullptr) {
+		gpuBuffer.name = "GPU";
+	}
+	append(&gpuBuffer, TraceEvent{ name, beginNs, endNs });
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// records a timeline of CPU and GPU spans, and writes it in the Chrome trace event format(JSON),
+// which can be opened in chrome://tracing or https://ui.perfetto.dev
+//
+// every thread records into a buffer of its own, so recording a span takes no locks: the owning thread
+// appends the event and then publishes the new event count with a release store. the buffers are
+// registered under a mutex, but that only happens the first time a thread records something.
+// a buffer is handed on to a new thread when its thread exits, so short-lived worker threads
+// do not pile up buffers.
+//
+// span names must be string literals, or otherwise outlive the recording.
+// all times are in nanoseconds, on the clock of traceNow().
+
+int64_t traceNow();
+
+// recording can be started and stopped at any time. stopping writes everything that was recorded
+// since the start to path.
+void traceStart();
+bool traceStop(const std::string& path);
+bool traceEnabled();
+
+// name of the calling thread in the trace.
+void traceThreadName(const char* name);
+
+// a span on the calling thread.
+void traceSpan(const char* name, int64_t beginNs, int64_t endNs);
+
+// a span on the separate GPU track. may only be called from one thread.
+void traceGpuSpan(const char* name, int64_t beginNs, int64_t endNs);
+
+// records a span from construction to destruction.
+struct TraceScope {
+	const char* name;
+	int64_t begin;
+
+	explicit TraceScope(const char* name_) : name(name_), begin(traceEnabled() ? traceNow() : -1) {
+	}
+	~TraceScope() {
+		if (begin >= 0) {
+			traceSpan(name, begin, traceNow());
+		}
+	}
+};